@@ -0,0 +1,129 @@
+/*
+Allocation policies -- Aligned and huge page backed memory for Buffer<T>
+Developed by: Travis Stewart
+*/
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <type_traits>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#define ALLOC_CACHE_LINE 64					//Bytes per cache line
+#define ALLOC_PAGE_SIZE 4096				//Bytes per (small) page
+#define ALLOC_HUGE_PAGE_SIZE (2 << 20)		//Bytes per huge page
+#define ALLOC_HUGE_PAGE_MIN (8 << 20)		//Smaller blocks aren't worth their own mapping
+
+//A policy hands out zeroed memory for n elements of T, nullptr on failure, and takes it back with the same n:
+//	static T* allocate(size_t n);
+//	static void release(T* p, size_t n);
+//The memory is raw, so T must be trivial (all zero bytes is its zero value).
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Memory aligned to ALIGN bytes (a power of two, at least sizeof(void*)), zeroed in one pass
+template <size_t ALIGN>
+struct aligned_allocator {
+	static void* allocate_bytes(size_t bytes) {
+		void* p = nullptr;
+		bytes = (bytes + ALIGN - 1) & ~(ALIGN - 1);
+	#if defined(_WIN32)
+		p = _aligned_malloc((bytes > 0)? bytes : ALIGN, ALIGN);
+	#else
+		if(posix_memalign(&p, ALIGN, (bytes > 0)? bytes : ALIGN) != 0) p = nullptr;
+	#endif
+		if(p != nullptr) memset(p, 0, bytes);
+		return p;
+	}
+
+	static void release_bytes(void* p) {
+	#if defined(_WIN32)
+		_aligned_free(p);
+	#else
+		free(p);
+	#endif
+	}
+
+	template <typename T>
+	static T* allocate(size_t n) {
+		static_assert(std::is_trivial<T>::value, "aligned_allocator only holds trivial types");
+		return (T*)allocate_bytes(n * sizeof(T));
+	}
+
+	template <typename T>
+	static void release(T* p, size_t /*n*/) { release_bytes(p); }
+};
+
+typedef aligned_allocator<ALLOC_CACHE_LINE> cache_aligned_allocator;
+typedef aligned_allocator<ALLOC_PAGE_SIZE> page_aligned_allocator;
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Large blocks get their own anonymous mapping, so they start out as untouched zero pages (no zeroing pass) and are
+//backed by huge pages where the system allows it: explicit MAP_HUGETLB pages if any are reserved, otherwise
+//transparent huge pages through madvise(MADV_HUGEPAGE). A multi-GB board then needs a few thousand TLB entries
+//instead of a million. Small blocks, and systems without mmap, fall back to page aligned memory.
+struct huge_page_allocator {
+	static inline size_t mapped_bytes(size_t bytes) { return (bytes + ALLOC_HUGE_PAGE_SIZE - 1) & ~(size_t)(ALLOC_HUGE_PAGE_SIZE - 1); }
+
+	static void* allocate_bytes(size_t bytes) {
+	#if !defined(_WIN32)
+		if(bytes >= ALLOC_HUGE_PAGE_MIN) {
+			size_t len = mapped_bytes(bytes);
+			void* p = MAP_FAILED;
+		#if defined(MAP_HUGETLB)
+			p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		#endif
+			if(p == MAP_FAILED) {
+				p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if(p == MAP_FAILED) return nullptr;
+			#if defined(MADV_HUGEPAGE)
+				madvise(p, len, MADV_HUGEPAGE);
+			#endif
+			}
+			return p;
+		}
+	#endif
+		return page_aligned_allocator::allocate_bytes(bytes);
+	}
+
+	static void release_bytes(void* p, size_t bytes) {
+		if(p == nullptr) return;
+	#if !defined(_WIN32)
+		if(bytes >= ALLOC_HUGE_PAGE_MIN) {
+			munmap(p, mapped_bytes(bytes));
+			return;
+		}
+	#endif
+		page_aligned_allocator::release_bytes(p);
+	}
+
+	template <typename T>
+	static T* allocate(size_t n) {
+		static_assert(std::is_trivial<T>::value, "huge_page_allocator only holds trivial types");
+		return (T*)allocate_bytes(n * sizeof(T));
+	}
+
+	template <typename T>
+	static void release(T* p, size_t n) { release_bytes(p, n * sizeof(T)); }
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
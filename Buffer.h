@@ -8,8 +8,20 @@ Developed by: Travis Stewart
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <type_traits>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include "Allocator.h"
 
 
 //=========================================================================================================================
@@ -18,12 +30,313 @@ Developed by: Travis Stewart
 
 enum BUFFER_FORMAT{GL=0, CV=1};
 
+template <typename T, typename A> class Buffer;
+template <typename T> class BufferView;
+
+//-------------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------Spans and Checks------------------------------------------------------
+//-------------------------------------------------------------------------------------------------------------------------
+
+//at(), row_ptr(), row() and plane() skip the range check operator() does, so hot loops come down to plain pointer
+//arithmetic. Building with BUFFER_BOUNDS_CHECK defined (the debug targets do) checks them again and aborts on a miss.
+#if defined(BUFFER_BOUNDS_CHECK)
+#define BUFFER_CHECK(cond) ((cond)? (void)0 : buffer_check_failed(#cond, __FILE__, __LINE__))
+inline void buffer_check_failed(const char* cond, const char* file, int line) {
+	fprintf(stderr, "%s:%i: Buffer index out of range (%s)\n", file, line, cond);
+	abort();
+}
+#else
+#define BUFFER_CHECK(cond) ((void)0)
+#endif
+
+//Iterator over elements that are stride apart, e.g. one channel of a GL row
+template <typename T>
+struct buffer_iterator {
+	typedef std::random_access_iterator_tag iterator_category;
+	typedef typename std::remove_const<T>::type value_type;
+	typedef ptrdiff_t difference_type;
+	typedef T* pointer;
+	typedef T& reference;
+
+	T* ptr;
+	ptrdiff_t stride;
+
+	buffer_iterator(T* p = nullptr, ptrdiff_t s = 1): ptr(p), stride(s) {}
+
+	inline T& operator * () const { return *ptr; }
+	inline T* operator -> () const { return ptr; }
+	inline T& operator [] (ptrdiff_t n) const { return ptr[n * stride]; }
+
+	inline buffer_iterator& operator ++ () { ptr += stride; return *this; }
+	inline buffer_iterator& operator -- () { ptr -= stride; return *this; }
+	inline buffer_iterator operator ++ (int) { buffer_iterator it = *this; ptr += stride; return it; }
+	inline buffer_iterator operator -- (int) { buffer_iterator it = *this; ptr -= stride; return it; }
+	inline buffer_iterator& operator += (ptrdiff_t n) { ptr += n * stride; return *this; }
+	inline buffer_iterator& operator -= (ptrdiff_t n) { ptr -= n * stride; return *this; }
+	inline buffer_iterator operator + (ptrdiff_t n) const { return buffer_iterator(ptr + n * stride, stride); }
+	inline buffer_iterator operator - (ptrdiff_t n) const { return buffer_iterator(ptr - n * stride, stride); }
+	inline ptrdiff_t operator - (const buffer_iterator& it) const { return (ptr - it.ptr) / stride; }
+
+	inline bool operator == (const buffer_iterator& it) const { return ptr == it.ptr; }
+	inline bool operator != (const buffer_iterator& it) const { return ptr != it.ptr; }
+	inline bool operator <  (const buffer_iterator& it) const { return ptr <  it.ptr; }
+	inline bool operator >  (const buffer_iterator& it) const { return ptr >  it.ptr; }
+	inline bool operator <= (const buffer_iterator& it) const { return ptr <= it.ptr; }
+	inline bool operator >= (const buffer_iterator& it) const { return ptr >= it.ptr; }
+};
+
+//n elements stride apart: a row or a plane of a Buffer. Doesn't own the memory, so it's only valid while the Buffer
+//keeps it (until it's resized or destroyed).
 template <typename T>
+struct buffer_span {
+	T* ptr;
+	size_t count;
+	ptrdiff_t stride;
+
+	buffer_span(T* p = nullptr, size_t n = 0, ptrdiff_t s = 1): ptr(p), count(n), stride(s) {}
+
+	inline T* data() const { return ptr; }
+	inline size_t size() const { return count; }
+	inline bool empty() const { return count == 0; }
+	inline bool contiguous() const { return stride == 1; }		//data() can be used as a plain array
+
+	inline T& operator [] (size_t i) const { BUFFER_CHECK(i < count); return ptr[i * stride]; }
+
+	//n elements starting at element i
+	inline buffer_span sub(size_t i, size_t n) const { BUFFER_CHECK(i + n <= count); return buffer_span(ptr + i * stride, n, stride); }
+
+	inline buffer_iterator<T> begin() const { return buffer_iterator<T>(ptr, stride); }
+	inline buffer_iterator<T> end() const { return buffer_iterator<T>(ptr + count * stride, stride); }
+};
+
+//-------------------------------------------------------------------------------------------------------------------------
+//-------------------------------------------------Layout Conversion-------------------------------------------------------
+//-------------------------------------------------------------------------------------------------------------------------
+
+#define BUFFER_FORMAT_BLOCK (128 << 10)		//Bytes of scratch per thread when changing formats, sized to stay in L2
+#define BUFFER_FORMAT_PARALLEL (1 << 20)	//Elements below which a format change stays on the calling thread
+
+//Runs f(begin, end, t) over [0, n) split into one contiguous range per thread t. threads 0 uses every core.
+template <typename F>
+void buffer_parallel(size_t n, unsigned threads, F f) {
+	if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+	threads = (unsigned)std::min<size_t>(threads, std::max<size_t>(n, 1));
+	if(threads <= 1) {
+		f((size_t)0, n, 0u);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	for(unsigned t = 1; t < threads; t++) workers.push_back(std::thread(f, n * t / threads, n * (t + 1) / threads, t));
+	f((size_t)0, n / threads, 0u);
+	for(size_t t = 0; t < workers.size(); t++) workers[t].join();
+}
+
+//Copies pixels [p0, p1) of an image with d channels between layouts: interleaved src into planar dst (planes n
+//elements apart) when to_planar, planar src into interleaved dst otherwise. Goes a block of pixels at a time, so the
+//interleaved side stays in cache while the d planar streams are walked.
+template <typename T>
+void buffer_relayout(const T* src, T* dst, size_t n, size_t d, size_t p0, size_t p1, bool to_planar) {
+	size_t block = std::max<size_t>(1, BUFFER_FORMAT_BLOCK / (sizeof(T) * d));
+	for(size_t b0 = p0; b0 < p1; b0 += block) {
+		size_t b1 = std::min(b0 + block, p1);
+		for(size_t z = 0; z < d; z++) {
+			if(to_planar) {
+				const T* in = src + z;
+				T* out = dst + z * n;
+				for(size_t p = b0; p < b1; p++) out[p] = in[p * d];
+			}
+			else {
+				const T* in = src + z * n;
+				T* out = dst + z;
+				for(size_t p = b0; p < b1; p++) out[p * d] = in[p];
+			}
+		}
+	}
+}
+
+//Transposes, in place, a rows x cols matrix whose entries are runs of c elements. Entry i moves to
+//(i % cols) * rows + i / cols. The permutation splits into cycles that share no entries; the leaders are found from
+//the indices alone (a byte per entry), then the threads rotate whole cycles with one entry of scratch each, so every
+//move is a contiguous copy of c elements.
+template <typename T>
+void buffer_transpose_runs(T* data, size_t rows, size_t cols, size_t c, unsigned threads) {
+	size_t total = rows * cols;
+	std::vector<uint8_t> seen(total, 0);
+	std::vector<size_t> leaders;
+	for(size_t i = 1; i + 1 < total; i++) {
+		if(seen[i]) continue;
+		size_t j = i;
+		do {
+			seen[j] = 1;
+			j = (j % cols) * rows + j / cols;
+		} while(j != i);
+		if((i % cols) * rows + i / cols != i) leaders.push_back(i);		//Fixed points don't move
+	}
+
+	buffer_parallel(leaders.size(), threads, [&](size_t begin, size_t end, unsigned t) {
+		std::unique_ptr<T[]> tmp(new T[c]);
+		for(size_t l = begin; l < end; l++) {
+			size_t start = leaders[l], cur = start;
+			std::copy(data + start * c, data + (start + 1) * c, tmp.get());
+			while(true) {
+				size_t prev = (cur % rows) * cols + cur / rows;		//The entry that lands on cur
+				if(prev == start) break;
+				std::copy(data + prev * c, data + (prev + 1) * c, data + cur * c);
+				cur = prev;
+			}
+			std::copy(tmp.get(), tmp.get() + c, data + cur * c);
+		}
+	});
+}
+
+//-------------------------------------------------------------------------------------------------------------------------
+//----------------------------------------------Expression Templates-------------------------------------------------------
+//-------------------------------------------------------------------------------------------------------------------------
+
+//The arithmetic operators don't compute anything. a * b + c / d builds a small tree of these nodes, and assigning the
+//tree to a Buffer evaluates it element by element in one loop straight into the destination: no temporaries and a
+//single pass over memory, which the compiler can vectorise. The nodes only point at the Buffers' memory, so an
+//expression has to be assigned in the statement that builds it (don't keep one in an auto variable).
+
+//Base of every expression node (E is the node type)
+template <typename E>
+struct buffer_expr {
+	inline const E& self() const { return static_cast<const E&>(*this); }
+};
+
+//A Buffer's or a BufferView's elements. Element (x, y, z) is x, y and z strides into data; linear means element i
+//is also just data[i] (any Buffer, or a view laid out like one), which lets assignment run as one flat loop.
+template <typename T>
+struct buffer_leaf : buffer_expr< buffer_leaf<T> > {
+	typedef T value_type;
+	static const bool scalar = false;
+	const T* data;
+	size_t width, height, depth;
+	ptrdiff_t x_stride, y_stride, z_stride;
+	int format;
+	bool linear;
+
+	template <typename A>
+	buffer_leaf(const Buffer<T, A>& buf): data(buf.data()), width(buf.width()), height(buf.height()), depth(buf.depth()), 
+			x_stride(buf.x_stride()), y_stride(buf.y_stride()), z_stride(buf.z_stride()), format(buf.format()), linear(true) {}
+
+	template <typename V>
+	buffer_leaf(const BufferView<V>& view): data(view.data()), width(view.width()), height(view.height()), depth(view.depth()), 
+			x_stride(view.x_stride()), y_stride(view.y_stride()), z_stride(view.z_stride()), format(view.format()), linear(view.linear()) {}
+
+	inline T operator[] (size_t i) const { return data[i]; }
+	inline T at(size_t x, size_t y, size_t z) const { 
+		BUFFER_CHECK(x < width && y < height && z < depth); 
+		return data[x * x_stride + y * y_stride + z * z_stride]; 
+	}
+};
+
+//A scalar used for every element
+template <typename T>
+struct buffer_scalar : buffer_expr< buffer_scalar<T> > {
+	typedef T value_type;
+	static const bool scalar = true;
+	T value;
+	size_t width = 0, height = 0, depth = 0;
+	int format = 0;
+	bool linear = true;
+
+	buffer_scalar(const T& t): value(t) {}
+	inline T operator[] (size_t i) const { return value; }
+	inline T at(size_t x, size_t y, size_t z) const { return value; }
+};
+
+//An element-wise operation. The result has the shape of the left operand, or the right one if the left is a scalar.
+//It's only linear if both sides are and they share a layout.
+template <typename L, typename R, typename OP>
+struct buffer_binary : buffer_expr< buffer_binary<L, R, OP> > {
+	typedef typename L::value_type value_type;
+	static const bool scalar = false;
+	L left;
+	R right;
+	size_t width, height, depth;
+	int format;
+	bool linear;
+
+	buffer_binary(const L& l, const R& r): left(l), right(r) {
+		width = (L::scalar)? r.width : l.width;
+		height = (L::scalar)? r.height : l.height;
+		depth = (L::scalar)? r.depth : l.depth;
+		format = (L::scalar)? r.format : l.format;
+		linear = l.linear && r.linear && (L::scalar || R::scalar || l.format == r.format);
+	}
+	inline value_type operator[] (size_t i) const { return OP::apply(left[i], right[i]); }
+	inline value_type at(size_t x, size_t y, size_t z) const { return OP::apply(left.at(x, y, z), right.at(x, y, z)); }
+};
+
+struct buffer_add { template <typename T> static inline T apply(const T& a, const T& b) { return a + b; } };
+struct buffer_sub { template <typename T> static inline T apply(const T& a, const T& b) { return a - b; } };
+struct buffer_mul { template <typename T> static inline T apply(const T& a, const T& b) { return a * b; } };
+struct buffer_div { template <typename T> static inline T apply(const T& a, const T& b) { return a / b; } };
+
+//Turns a Buffer, a BufferView or an expression into its node
+template <typename X> struct buffer_operand { static const bool value = false; };
+template <typename T, typename A> struct buffer_operand< Buffer<T, A> > { 
+	static const bool value = true; 
+	typedef buffer_leaf<T> type; 
+	static inline type get(const Buffer<T, A>& buf) { return type(buf); }
+};
+template <typename T> struct buffer_operand< BufferView<T> > { 
+	static const bool value = true; 
+	typedef buffer_leaf<typename std::remove_const<T>::type> type; 
+	static inline type get(const BufferView<T>& view) { return type(view); }
+};
+template <typename L, typename R, typename OP> struct buffer_operand< buffer_binary<L, R, OP> > { 
+	static const bool value = true; 
+	typedef buffer_binary<L, R, OP> type; 
+	static inline const type& get(const type& e) { return e; }
+};
+
+//Operand op operand, operand op scalar and scalar op operand
+#define BUFFER_EXPR_OPERATOR(OPERATOR, OP)																						\
+template <typename L, typename R>																								\
+inline typename std::enable_if<buffer_operand<L>::value && buffer_operand<R>::value,											\
+		buffer_binary<typename buffer_operand<L>::type, typename buffer_operand<R>::type, OP> >::type							\
+operator OPERATOR (const L& l, const R& r) {																					\
+	return buffer_binary<typename buffer_operand<L>::type, typename buffer_operand<R>::type, OP>(buffer_operand<L>::get(l), buffer_operand<R>::get(r));	\
+}																																\
+template <typename L>																											\
+inline typename std::enable_if<buffer_operand<L>::value,																		\
+		buffer_binary<typename buffer_operand<L>::type, buffer_scalar<typename buffer_operand<L>::type::value_type>, OP> >::type	\
+operator OPERATOR (const L& l, const typename buffer_operand<L>::type::value_type& t) {											\
+	typedef buffer_scalar<typename buffer_operand<L>::type::value_type> S;														\
+	return buffer_binary<typename buffer_operand<L>::type, S, OP>(buffer_operand<L>::get(l), S(t));							\
+}																																\
+template <typename R>																											\
+inline typename std::enable_if<buffer_operand<R>::value,																		\
+		buffer_binary<buffer_scalar<typename buffer_operand<R>::type::value_type>, typename buffer_operand<R>::type, OP> >::type	\
+operator OPERATOR (const typename buffer_operand<R>::type::value_type& t, const R& r) {											\
+	typedef buffer_scalar<typename buffer_operand<R>::type::value_type> S;														\
+	return buffer_binary<S, typename buffer_operand<R>::type, OP>(S(t), buffer_operand<R>::get(r));							\
+}
+
+BUFFER_EXPR_OPERATOR(+, buffer_add)
+BUFFER_EXPR_OPERATOR(-, buffer_sub)
+BUFFER_EXPR_OPERATOR(*, buffer_mul)
+BUFFER_EXPR_OPERATOR(/, buffer_div)
+
+#undef BUFFER_EXPR_OPERATOR
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//A is the allocation policy (see Allocator.h). The default aligns the data to a cache line; huge_page_allocator suits
+//boards of hundreds of MB or more.
+template <typename T, typename A = cache_aligned_allocator>
 class Buffer {
 private:
 	T* buffer_data;
-	int buffer_width, buffer_height, buffer_depth, buffer_format;
-	bool buffer_deleted;	//Used to handle Buffers on the stack
+	size_t buffer_width, buffer_height, buffer_depth;	//Each is at most INT_MAX, their product only has to fit a size_t
+	int buffer_format;
+	bool buffer_owner;		//The memory is released with the Buffer. Views from copy() don't own theirs.
+	size_t buffer_capacity;	//Elements allocated, can be more than size() after shrinking
 	
 public:
 	//-------------------------------------------------------------------------------------------------------------------------
@@ -36,101 +349,151 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 
 	//Constructor(s)
-	Buffer(): buffer_data(nullptr), buffer_width(0), buffer_height(0), buffer_depth(0), buffer_format(BUFFER_FORMAT::GL), buffer_deleted(false) {}
+	Buffer(): buffer_data(nullptr), buffer_width(0), buffer_height(0), buffer_depth(0), buffer_format(BUFFER_FORMAT::GL), buffer_owner(false), buffer_capacity(0) {}
 	
 	//Default Format (BUFFER_FORMAT::GL)
-	Buffer(int w, int h, int d): buffer_width(w), buffer_height(h), buffer_depth(d), buffer_format(BUFFER_FORMAT::GL) { 
-		check_diminsions();
-		allocate(buffer_width * buffer_height * buffer_depth);
+	Buffer(ptrdiff_t w, ptrdiff_t h, ptrdiff_t d): buffer_data(nullptr), buffer_format(BUFFER_FORMAT::GL), buffer_owner(false), buffer_capacity(0) { 
+		create(w, h, d);
 	}
 
-	Buffer(int w, int h, int d, const T t): buffer_width(w), buffer_height(h), buffer_depth(d), buffer_format(BUFFER_FORMAT::GL) { 
-		check_diminsions();
-		allocate(buffer_width * buffer_height * buffer_depth);
+	Buffer(ptrdiff_t w, ptrdiff_t h, ptrdiff_t d, const T t): buffer_data(nullptr), buffer_format(BUFFER_FORMAT::GL), buffer_owner(false), buffer_capacity(0) { 
+		if(create(w, h, d)) clear(t);
 	}
 
-	Buffer(int w, int h, int d, const T* t): buffer_width(w), buffer_height(h), buffer_depth(d), buffer_format(BUFFER_FORMAT::GL) { 
-		check_diminsions();
-		allocate(buffer_width * buffer_height * buffer_depth);
+	Buffer(ptrdiff_t w, ptrdiff_t h, ptrdiff_t d, const T* t): buffer_data(nullptr), buffer_format(BUFFER_FORMAT::GL), buffer_owner(false), buffer_capacity(0) { 
+		if(create(w, h, d) && t != nullptr) std::copy(t, t + size(), buffer_data);
 	}
 
 	//With Format
-	Buffer(int w, int h, int d, int f): buffer_width(w), buffer_height(h), buffer_depth(d), buffer_format(f) { 
-		check_diminsions();
-		allocate(buffer_width * buffer_height * buffer_depth);
+	Buffer(ptrdiff_t w, ptrdiff_t h, ptrdiff_t d, int f): buffer_data(nullptr), buffer_format(f), buffer_owner(false), buffer_capacity(0) { 
+		create(w, h, d);
+	}
+
+	Buffer(ptrdiff_t w, ptrdiff_t h, ptrdiff_t d, int f, const T t): buffer_data(nullptr), buffer_format(f), buffer_owner(false), buffer_capacity(0) { 
+		if(create(w, h, d)) clear(t);
 	}
 
-	Buffer(int w, int h, int d, int f, const T t): buffer_width(w), buffer_height(h), buffer_depth(d), buffer_format(f) { 
-		check_diminsions();
-		allocate(buffer_width * buffer_height * buffer_depth);
+	Buffer(ptrdiff_t w, ptrdiff_t h, ptrdiff_t d, int f, const T* t): buffer_data(nullptr), buffer_format(f), buffer_owner(false), buffer_capacity(0) { 
+		if(create(w, h, d) && t != nullptr) std::copy(t, t + size(), buffer_data);
 	}
 
-	Buffer(int w, int h, int d, int f, const T* t): buffer_width(w), buffer_height(h), buffer_depth(d), buffer_format(f) { 
-		check_diminsions();
-		allocate(buffer_width * buffer_height * buffer_depth);
+	//Copy Constructor (deep copy, a copy of a view owns its memory)
+	Buffer(const Buffer<T, A>& buf): buffer_data(nullptr), buffer_width(0), buffer_height(0), buffer_depth(0), buffer_format(buf.buffer_format), buffer_owner(false), buffer_capacity(0) {
+		if(buf.buffer_data != nullptr && create(buf.buffer_width, buf.buffer_height, buf.buffer_depth)) 
+			std::copy(buf.buffer_data, buf.buffer_data + size(), buffer_data);
 	}
 
-/*	//Copy Constructor
-	Buffer(const Buffer<T>& buf) {
-		buffer_format = buf.format();
-		buffer_width = buf.width();
-		buffer_height = buf.height();
-		buffer_depth = buf.depth();
-		//buffer_data = buf.data();		//Shallow copy
+	//Move Constructor. Takes the memory (and ownership) and leaves buf empty, so returned temporaries cost no copy.
+	Buffer(Buffer<T, A>&& buf) noexcept: buffer_data(buf.buffer_data), buffer_width(buf.buffer_width), buffer_height(buf.buffer_height), buffer_depth(buf.buffer_depth), 
+			buffer_format(buf.buffer_format), buffer_owner(buf.buffer_owner), buffer_capacity(buf.buffer_capacity) {
+		buf.forget();
+	}
 
-		//Allocate new memory
-		buffer_data = new T(buffer_width * buffer_height * buffer_depth);
+	//Copy Assignment. Reuses this Buffer's memory when it owns enough.
+	Buffer<T, A>& operator = (const Buffer<T, A>& buf) {
+		if(this == &buf) return *this;
+		buffer_format = buf.buffer_format;
+		if(buf.buffer_data == nullptr) {
+			deallocate();
+			set_size(0, 0, 0);
+			return *this;
+		}
+		if(!buffer_owner || buffer_data == nullptr || buf.size() > buffer_capacity) {
+			deallocate();
+			if(!create(buf.buffer_width, buf.buffer_height, buf.buffer_depth)) return *this;
+		}
+		else set_size(buf.buffer_width, buf.buffer_height, buf.buffer_depth);
+		std::copy(buf.buffer_data, buf.buffer_data + size(), buffer_data);
+		return *this;
+	}
 
-		//Deep copy
-		for(int i = 0; i < buf.size(); i++) 
-			buffer_data[i] = buf(i);
+	//Move Assignment
+	Buffer<T, A>& operator = (Buffer<T, A>&& buf) noexcept {
+		if(this == &buf) return *this;
+		deallocate();
+		buffer_data = buf.buffer_data;
+		set_size(buf.buffer_width, buf.buffer_height, buf.buffer_depth);
+		buffer_format = buf.buffer_format;
+		buffer_owner = buf.buffer_owner;
+		buffer_capacity = buf.buffer_capacity;
+		buf.forget();
+		return *this;
+	}
+
+	void swap(Buffer<T, A>& buf) noexcept {
+		std::swap(buffer_data, buf.buffer_data);
+		std::swap(buffer_width, buf.buffer_width);
+		std::swap(buffer_height, buf.buffer_height);
+		std::swap(buffer_depth, buf.buffer_depth);
+		std::swap(buffer_format, buf.buffer_format);
+		std::swap(buffer_owner, buf.buffer_owner);
+		std::swap(buffer_capacity, buf.buffer_capacity);
 	}
-//*/
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
-	inline bool allocate(int _size) {
-		try {
-			buffer_data = new T[_size]();
-			for(int i = 0; i < _size; i++) 
-				buffer_data[i] = NULL;
+	//Sets the diminsions (anything below 1 becomes 1) and allocates the buffer. If the size overflows or the memory
+	//isn't available the buffer is left empty: size() is 0 and data() is nullptr.
+	inline bool create(ptrdiff_t w, ptrdiff_t h, ptrdiff_t d) {
+		size_t _size = 0;
+		buffer_format = (buffer_format < 0)? 0 : buffer_format;
+		if(checked_size(w, h, d, _size) && allocate(_size)) {
+			set_size(std::max<ptrdiff_t>(w, 1), std::max<ptrdiff_t>(h, 1), std::max<ptrdiff_t>(d, 1));
 			return true;
 		}
-		catch(...) {}
+		set_size(0, 0, 0);
 		return false;
 	}
 
+	//Number of elements in a w x h x d buffer, false if an axis is past INT_MAX or the bytes don't fit a size_t
+	static inline bool checked_size(ptrdiff_t w, ptrdiff_t h, ptrdiff_t d, size_t& _size) {
+		size_t sw = std::max<ptrdiff_t>(w, 1), sh = std::max<ptrdiff_t>(h, 1), sd = std::max<ptrdiff_t>(d, 1);
+		if(sw > INT_MAX || sh > INT_MAX || sd > INT_MAX) return false;
+		if(sw > SIZE_MAX / sh || sw * sh > SIZE_MAX / sd || sw * sh * sd > SIZE_MAX / sizeof(T)) return false;
+		_size = sw * sh * sd;
+		return true;
+	}
+
+	//The policy hands back memory that's already zeroed (or untouched zero pages), so there's no clearing pass here
+	inline bool allocate(size_t _size) {
+		buffer_data = A::template allocate<T>(_size);
+		buffer_capacity = (buffer_data != nullptr)? _size : 0;
+		buffer_owner = buffer_data != nullptr;
+		return buffer_data != nullptr;
+	}
+
 	//-------------------------------------------------------------------------------------------------------------------------
 
+	//Releases the memory if this Buffer owns it; a view just lets go of it. Returns true if memory was released.
 	inline bool deallocate() {
-		try {
-			if(buffer_data != nullptr && !buffer_deleted) {
-				delete[] buffer_data; 
-				buffer_data = nullptr;
-				buffer_deleted = true;
-				return true;
-			}
-		}
-		catch(...) {}
-		return false;
+		bool released = buffer_data != nullptr && buffer_owner;
+		if(released) A::release(buffer_data, buffer_capacity); 
+		buffer_data = nullptr;
+		buffer_owner = false;
+		buffer_capacity = 0;
+		return released;
+	}
+
+	//Leaves the Buffer empty without releasing anything (after its memory was moved elsewhere)
+	inline void forget() {
+		buffer_data = nullptr;
+		set_size(0, 0, 0);
+		buffer_owner = false;
+		buffer_capacity = 0;
 	}
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
 	//Private variable access
 	T* data() { return buffer_data; }
-	inline int width() const { return buffer_width; }
-	inline int height() const { return buffer_height; }
-	inline int depth() const { return buffer_depth; }
+	const T* data() const { return buffer_data; }
+	inline bool owner() const { return buffer_owner; }
+	inline int width() const { return (int)buffer_width; }
+	inline int height() const { return (int)buffer_height; }
+	inline int depth() const { return (int)buffer_depth; }
 	inline int format() const { return buffer_format; }
-	inline int size() const { return buffer_width * buffer_height * buffer_depth; }
-	
-	inline void check_diminsions() {
-		buffer_width  = (buffer_width  <= 0)? 1 : buffer_width;
-		buffer_height = (buffer_height <= 0)? 1 : buffer_height;
-		buffer_depth  = (buffer_depth  <= 0)? 1 : buffer_depth;
-		buffer_format = (buffer_format < 0 )? 0 : buffer_format;
-	}
+	inline size_t size() const { return buffer_width * buffer_height * buffer_depth; }
+	inline size_t capacity() const { return buffer_capacity; }
 
 	
 
@@ -140,176 +503,446 @@ public:
 	//inline T& operator[] (int i) { return buffer_data[i]; }		//Only works with indexing into the 1D array
 	
 	//3D Get
-	inline T operator() (int x, int y, int z) const {	/* Get */
-		if(x < 0 || x >= buffer_width || y < 0 || y >= buffer_height || z < 0 || z >= buffer_depth) 
+	inline T operator() (ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) const {	/* Get */
+		if(!inside(x, y, z)) 
 			return buffer_data[0]; 
-		return (buffer_format)? buffer_data[x + (y * buffer_width) + (z * buffer_width * buffer_height)] : buffer_data[ (y * buffer_width * buffer_depth) + (x * buffer_depth) + z ]; 
+		return buffer_data[idx(x, y, z)]; 
 	}
 
 	//3D Set	
-	inline T& operator() (int x, int y, int z) {	/* Set */
-		if(x < 0 || x >= buffer_width || y < 0 || y >= buffer_height || z < 0 || z >= buffer_depth) 
+	inline T& operator() (ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) {	/* Set */
+		if(!inside(x, y, z)) 
 			return buffer_data[0]; 
-		return (buffer_format)? buffer_data[x + (y * buffer_width) + (z * buffer_width * buffer_height)] : buffer_data[ (y * buffer_width * buffer_depth) + (x * buffer_depth) + z ]; 
+		return buffer_data[idx(x, y, z)]; 
 	}
 	
 	//-------------------------------------------------------------
 
 	//2D Get
-	inline T operator() (int x, int y) const {	/* Get */
-		if(x < 0 || x >= buffer_width || y < 0 || y >= buffer_height) 
+	inline T operator() (ptrdiff_t x, ptrdiff_t y) const {	/* Get */
+		if(!inside(x, y, 0)) 
 			return buffer_data[0]; 
-		return (buffer_format)? buffer_data[x + (y * buffer_width) + (0 * buffer_width * buffer_height)] : buffer_data[ (y * buffer_width * buffer_depth) + (x * buffer_depth) + 0 ]; 
+		return buffer_data[idx(x, y, 0)]; 
 	}
 
 	//2D Set
-	inline T& operator() (int x, int y) {	/* Set */
-		if(x < 0 || x >= buffer_width || y < 0 || y >= buffer_height) 
+	inline T& operator() (ptrdiff_t x, ptrdiff_t y) {	/* Set */
+		if(!inside(x, y, 0)) 
 			return buffer_data[0]; 
-		return (buffer_format)? buffer_data[x + (y * buffer_width) + (0 * buffer_width * buffer_height)] : buffer_data[ (y * buffer_width * buffer_depth) + (x * buffer_depth) + 0 ]; 
+		return buffer_data[idx(x, y, 0)]; 
 	}
 
 	//-------------------------------------------------------------
 
 	//1D Get
-	inline T operator() (int i) const {	  /* Get */
+	inline T operator() (size_t i) const {	  /* Get */
 		return buffer_data[i]; 
 	}
 
 	//1D Set	
-	inline T& operator() (int i) {	/* Set */
+	inline T& operator() (size_t i) {	/* Set */
 		return buffer_data[i]; 
 	}			
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
-	//Compute Index
-	inline int idx(int x, int y, int z) { return (buffer_format)? x + (y * buffer_width) + (z * buffer_width * buffer_height) : (y * buffer_width * buffer_depth) + (x * buffer_depth) + z; }
-	inline int idx(int x, int y) { return (y * buffer_width) + x; }
+	//Compute Index. Every term is a size_t, so boards with more than INT_MAX elements index correctly.
+	inline size_t idx(size_t x, size_t y, size_t z) const { return (buffer_format)? x + (y * buffer_width) + (z * buffer_width * buffer_height) : (y * buffer_width * buffer_depth) + (x * buffer_depth) + z; }
+	inline size_t idx(size_t x, size_t y) const { return (y * buffer_width) + x; }
 
-	//Enables index wrapping in the buffer w.r.t the width, height, or depth.
-	int wrapX(const int& idx) { return (buffer_width + idx) % buffer_width; }
-	int wrapY(const int& idx) { return (buffer_height + idx) % buffer_height; }
-	int wrapZ(const int& idx) { return (buffer_depth + idx) % buffer_depth; }
+	inline bool inside(ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) const {
+		return x >= 0 && (size_t)x < buffer_width && y >= 0 && (size_t)y < buffer_height && z >= 0 && (size_t)z < buffer_depth;
+	}
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Unchecked access (see BUFFER_CHECK). x_stride() is the distance between neighbouring elements of a row and
+	//y_stride() between rows: 1 and width for CV, depth and width * depth for GL.
+	inline ptrdiff_t x_stride() const { return (buffer_format)? 1 : buffer_depth; }
+	inline ptrdiff_t y_stride() const { return (buffer_format)? buffer_width : buffer_width * buffer_depth; }
+	inline ptrdiff_t z_stride() const { return (buffer_format)? buffer_width * buffer_height : 1; }
+
+	inline T& at(ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) { BUFFER_CHECK(inside(x, y, z)); return buffer_data[idx(x, y, z)]; }
+	inline const T& at(ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) const { BUFFER_CHECK(inside(x, y, z)); return buffer_data[idx(x, y, z)]; }
+
+	//First element of row y in plane z
+	inline T* row_ptr(ptrdiff_t y, ptrdiff_t z) { BUFFER_CHECK(inside(0, y, z)); return buffer_data + idx(0, y, z); }
+	inline const T* row_ptr(ptrdiff_t y, ptrdiff_t z) const { BUFFER_CHECK(inside(0, y, z)); return buffer_data + idx(0, y, z); }
+
+	inline buffer_span<T> row(ptrdiff_t y, ptrdiff_t z) { return buffer_span<T>(row_ptr(y, z), buffer_width, x_stride()); }
+	inline buffer_span<const T> row(ptrdiff_t y, ptrdiff_t z) const { return buffer_span<const T>(row_ptr(y, z), buffer_width, x_stride()); }
 
-	//Enables index wrapping in the buffer w.r.t the given limit value.
-	int wrapIdx(const int& limit, const int& arg) { return (limit + arg) % limit; }
+	//Plane z, one row after another (the rows of a plane are always evenly spaced)
+	inline buffer_span<T> plane(ptrdiff_t z) { return buffer_span<T>(row_ptr(0, z), buffer_width * buffer_height, x_stride()); }
+	inline buffer_span<const T> plane(ptrdiff_t z) const { return buffer_span<const T>(row_ptr(0, z), buffer_width * buffer_height, x_stride()); }
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
-	//Simple Arithmetic Operations
-	void operator += (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) buffer_data[i] = buffer_data[i] + buf(i); }
-	void operator -= (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) buffer_data[i] = buffer_data[i] - buf(i); }
-	void operator *= (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) buffer_data[i] = buffer_data[i] * buf(i); }
-	void operator /= (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) buffer_data[i] = buffer_data[i] / buf(i); }
+	//Views (see BufferView) of the whole Buffer, the w x h region at (x, y) in every channel, channel z, or tile
+	//(tx, ty) of size x size elements. Nothing is allocated or copied.
+	BufferView<T> view() { return BufferView<T>(buffer_data, buffer_width, buffer_height, buffer_depth, x_stride(), y_stride(), z_stride(), buffer_format); }
+	BufferView<const T> view() const { return BufferView<const T>(buffer_data, buffer_width, buffer_height, buffer_depth, x_stride(), y_stride(), z_stride(), buffer_format); }
 
-	inline void operator += (const T& t) { for(int i = 0; i < size(); i++) buffer_data[i] = buffer_data[i] + t; }
-	inline void operator -= (const T& t) { for(int i = 0; i < size(); i++) buffer_data[i] = buffer_data[i] - t; }
-	inline void operator *= (const T& t) { for(int i = 0; i < size(); i++) buffer_data[i] = buffer_data[i] * t; }
-	inline void operator /= (const T& t) { for(int i = 0; i < size(); i++) buffer_data[i] = buffer_data[i] / t; }
+	BufferView<T> region(ptrdiff_t x, ptrdiff_t y, ptrdiff_t w, ptrdiff_t h) { return view().region(x, y, w, h); }
+	BufferView<const T> region(ptrdiff_t x, ptrdiff_t y, ptrdiff_t w, ptrdiff_t h) const { return view().region(x, y, w, h); }
+	BufferView<T> channel(ptrdiff_t z) { return view().channel(z); }
+	BufferView<const T> channel(ptrdiff_t z) const { return view().channel(z); }
+	BufferView<T> tile(ptrdiff_t tx, ptrdiff_t ty, ptrdiff_t size) { return view().tile(tx, ty, size); }
+	BufferView<const T> tile(ptrdiff_t tx, ptrdiff_t ty, ptrdiff_t size) const { return view().tile(tx, ty, size); }
 
-	Buffer<T> operator + (const Buffer<T>& buf) { Buffer<T> t_buf = like(); for(int i = 0; i < size(); i++) t_buf(i) = buffer_data[i] + buf(i); return t_buf;}
-	Buffer<T> operator - (const Buffer<T>& buf) { Buffer<T> t_buf = like(); for(int i = 0; i < size(); i++) t_buf(i) = buffer_data[i] - buf(i); return t_buf;}
-	Buffer<T> operator * (const Buffer<T>& buf) { Buffer<T> t_buf = like(); for(int i = 0; i < size(); i++) t_buf(i) = buffer_data[i] * buf(i); return t_buf;}
-	Buffer<T> operator / (const Buffer<T>& buf) { Buffer<T> t_buf = like(); for(int i = 0; i < size(); i++) t_buf(i) = buffer_data[i] / buf(i); return t_buf;}
+	//Enables index wrapping in the buffer w.r.t the width, height, or depth.
+	ptrdiff_t wrapX(ptrdiff_t idx) const { return wrapIdx(buffer_width, idx); }
+	ptrdiff_t wrapY(ptrdiff_t idx) const { return wrapIdx(buffer_height, idx); }
+	ptrdiff_t wrapZ(ptrdiff_t idx) const { return wrapIdx(buffer_depth, idx); }
+
+	//Enables index wrapping in the buffer w.r.t the given limit value. Indices already inside skip the (64-bit) division.
+	static ptrdiff_t wrapIdx(ptrdiff_t limit, ptrdiff_t arg) { 
+		if(arg >= 0 && arg < limit) return arg;
+		return (limit + arg % limit) % limit; 
+	}
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Simple Arithmetic Operations. The binary operators build expressions (see above) that are evaluated on assignment.
+	template <typename E>
+	Buffer(const buffer_expr<E>& expr): buffer_data(nullptr), buffer_width(0), buffer_height(0), buffer_depth(0), buffer_format(BUFFER_FORMAT::GL), buffer_owner(false), buffer_capacity(0) {
+		assign(expr.self());
+	}
+
+	template <typename E>
+	Buffer<T, A>& operator = (const buffer_expr<E>& expr) { 
+		assign(expr.self()); 
+		return *this; 
+	}
+
+	template <typename E> void operator += (const buffer_expr<E>& expr) { *this = *this + expr.self(); }
+	template <typename E> void operator -= (const buffer_expr<E>& expr) { *this = *this - expr.self(); }
+	template <typename E> void operator *= (const buffer_expr<E>& expr) { *this = *this * expr.self(); }
+	template <typename E> void operator /= (const buffer_expr<E>& expr) { *this = *this / expr.self(); }
+
+	void operator += (const Buffer<T, A>& buf) { *this = *this + buf; }
+	void operator -= (const Buffer<T, A>& buf) { *this = *this - buf; }
+	void operator *= (const Buffer<T, A>& buf) { *this = *this * buf; }
+	void operator /= (const Buffer<T, A>& buf) { *this = *this / buf; }
+
+	inline void operator += (const T& t) { *this = *this + t; }
+	inline void operator -= (const T& t) { *this = *this - t; }
+	inline void operator *= (const T& t) { *this = *this * t; }
+	inline void operator /= (const T& t) { *this = *this / t; }
+
+private:
+	//Evaluates an expression into this Buffer in one pass. Each element only depends on the same element of the
+	//operands, so the Buffer may appear in its own expression as long as its shape doesn't change.
+	template <typename E>
+	void assign(const E& expr) {
+		if(expr.width * expr.height * expr.depth == 0) {
+			deallocate();
+			set_size(0, 0, 0);
+			return;
+		}
+		if(!buffer_owner || buffer_width != expr.width || buffer_height != expr.height || buffer_depth != expr.depth) {
+			//Evaluate into new memory first, the expression may still read the old
+			Buffer<T, A> t_buf(expr.width, expr.height, expr.depth, expr.format);
+			if(t_buf.data() != nullptr) t_buf.assign(expr);
+			*this = std::move(t_buf);
+			return;
+		}
+		buffer_format = expr.format;
 
-	Buffer<T> operator + (const T& t) { Buffer<T> t_buf = like(); for(int i = 0; i < size(); i++) t_buf(i) = buffer_data[i] + t; return t_buf;}
-	Buffer<T> operator - (const T& t) { Buffer<T> t_buf = like(); for(int i = 0; i < size(); i++) t_buf(i) = buffer_data[i] - t; return t_buf;}
-	Buffer<T> operator * (const T& t) { Buffer<T> t_buf = like(); for(int i = 0; i < size(); i++) t_buf(i) = buffer_data[i] * t; return t_buf;}
-	Buffer<T> operator / (const T& t) { Buffer<T> t_buf = like(); for(int i = 0; i < size(); i++) t_buf(i) = buffer_data[i] / t; return t_buf;}
+		if(expr.linear) {
+			T* out = buffer_data;
+			size_t n = size();
+			for(size_t i = 0; i < n; i++) out[i] = expr[i];
+			return;
+		}
 
-	friend Buffer<T> operator + (const T& t, const Buffer<T>& buf) { Buffer<T> t_buf = buf.like(); for(int i = 0; i < buf.size(); i++) t_buf(i) = t + buf(i); return t_buf;}
-	friend Buffer<T> operator - (const T& t, const Buffer<T>& buf) { Buffer<T> t_buf = buf.like(); for(int i = 0; i < buf.size(); i++) t_buf(i) = t - buf(i); return t_buf;}
-	friend Buffer<T> operator * (const T& t, const Buffer<T>& buf) { Buffer<T> t_buf = buf.like(); for(int i = 0; i < buf.size(); i++) t_buf(i) = t * buf(i); return t_buf;}
-	friend Buffer<T> operator / (const T& t, const Buffer<T>& buf) { Buffer<T> t_buf = buf.like(); for(int i = 0; i < buf.size(); i++) t_buf(i) = t / buf(i); return t_buf;}
+		//Views or mixed layouts, walk the coordinates
+		ptrdiff_t s = x_stride();
+		for(size_t z = 0; z < buffer_depth; z++)
+			for(size_t y = 0; y < buffer_height; y++) {
+				T* out = row_ptr(y, z);
+				for(size_t x = 0; x < buffer_width; x++) out[x * s] = expr.at(x, y, z);
+			}
+	}
+
+public:
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
 	//Boolean Operators
-	bool operator == (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) if(buffer_data[i] != buf(i)) return false; return true; }
-	bool operator <  (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) if(buffer_data[i] >= buf(i)) return false; return true; }
-	bool operator >  (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) if(buffer_data[i] <= buf(i)) return false; return true; }
-	bool operator <= (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) if(buffer_data[i] >  buf(i)) return false; return true; }
-	bool operator >= (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) if(buffer_data[i] <  buf(i)) return false; return true; }
-	bool operator != (const Buffer<T>& buf) { for(int i = 0; i < size(); i++) if(buffer_data[i] == buf(i)) return false; return true; }
-
-	bool operator == (const T& t) { for(int i = 0; i < size(); i++) if(buffer_data[i] != t) return false; return true; }
-	bool operator <  (const T& t) { for(int i = 0; i < size(); i++) if(buffer_data[i] >= t) return false; return true; }
-	bool operator >  (const T& t) { for(int i = 0; i < size(); i++) if(buffer_data[i] <= t) return false; return true; }
-	bool operator <= (const T& t) { for(int i = 0; i < size(); i++) if(buffer_data[i] >  t) return false; return true; }
-	bool operator >= (const T& t) { for(int i = 0; i < size(); i++) if(buffer_data[i] <  t) return false; return true; }
-	bool operator != (const T& t) { for(int i = 0; i < size(); i++) if(buffer_data[i] == t) return false; return true; }
+	bool operator == (const Buffer<T, A>& buf) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] != buf(i)) return false; return true; }
+	bool operator <  (const Buffer<T, A>& buf) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] >= buf(i)) return false; return true; }
+	bool operator >  (const Buffer<T, A>& buf) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] <= buf(i)) return false; return true; }
+	bool operator <= (const Buffer<T, A>& buf) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] >  buf(i)) return false; return true; }
+	bool operator >= (const Buffer<T, A>& buf) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] <  buf(i)) return false; return true; }
+	bool operator != (const Buffer<T, A>& buf) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] == buf(i)) return false; return true; }
+
+	bool operator == (const T& t) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] != t) return false; return true; }
+	bool operator <  (const T& t) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] >= t) return false; return true; }
+	bool operator >  (const T& t) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] <= t) return false; return true; }
+	bool operator <= (const T& t) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] >  t) return false; return true; }
+	bool operator >= (const T& t) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] <  t) return false; return true; }
+	bool operator != (const T& t) { for(size_t i = 0; i < size(); i++) if(buffer_data[i] == t) return false; return true; }
 
 	//-------------------------------------------------------------------------------------------------------------------------
 	
 	//Like function
-	Buffer<T> like_1() { return Buffer<T>(buffer_width, 1, 1, buffer_format); }	//Creates a Buffer with the same 1D diminsions
-	Buffer<T> like_2() { return Buffer<T>(buffer_width, buffer_height, 1, buffer_format); }	//Creates a Buffer with the same 2D diminsions
-	Buffer<T> like() { return Buffer<T>(buffer_width, buffer_height, buffer_depth, buffer_format); }	//Creates a Buffer with the same 3D diminsions
+	Buffer<T, A> like_1() { return Buffer<T, A>(buffer_width, 1, 1, buffer_format); }	//Creates a Buffer with the same 1D diminsions
+	Buffer<T, A> like_2() { return Buffer<T, A>(buffer_width, buffer_height, 1, buffer_format); }	//Creates a Buffer with the same 2D diminsions
+	Buffer<T, A> like() { return Buffer<T, A>(buffer_width, buffer_height, buffer_depth, buffer_format); }	//Creates a Buffer with the same 3D diminsions
 
 	//Copy function
-	Buffer<T> clone() { return Buffer<T>(buffer_width, buffer_height, buffer_depth, buffer_format, data()); }
-	Buffer<T> copy() { return Buffer<T>(buffer_width, buffer_height, buffer_depth, buffer_format, data()); }	//Update to be a shallow copy
+	Buffer<T, A> clone() const { return Buffer<T, A>(*this); }	//Deep copy
+
+	//Shallow copy: a view of this Buffer's memory that doesn't own it, so it's only valid while this Buffer keeps the
+	//memory (until it's resized or destroyed). Writes through either one are seen by both.
+	Buffer<T, A> copy() { 
+		Buffer<T, A> t_buf;
+		t_buf.buffer_data = buffer_data;
+		t_buf.set_size(buffer_width, buffer_height, buffer_depth);
+		t_buf.buffer_format = buffer_format;
+		t_buf.buffer_capacity = size();
+		return t_buf;
+	}
 
-	void clear() { for(int i = 0; i < size(); i++) buffer_data[i] = NULL; }
-	void clear(const T& t) { for(int i = 0; i < size(); i++) buffer_data[i] = t; }
+	void clear() { for(size_t i = 0; i < size(); i++) buffer_data[i] = T(); }
+	void clear(const T& t) { for(size_t i = 0; i < size(); i++) buffer_data[i] = t; }
 
-	void clearX(const int& x) { for(int y = 0; y < buffer_height; y++) for(int z = 0; z < buffer_depth; z++) buffer_data[idx(x, y, z)] = NULL; }
-	void clearY(const int& y) { for(int x = 0; x < buffer_width; x++) for(int z = 0; z < buffer_depth; z++) buffer_data[idx(x, y, z)] = NULL; }
-	void clearZ(const int& z) { for(int y = 0; y < buffer_height; y++) for(int x = 0; x < buffer_width; x++) buffer_data[idx(x, y, z)] = NULL; }
+	void clearX(const int& x) { for(size_t y = 0; y < buffer_height; y++) for(size_t z = 0; z < buffer_depth; z++) buffer_data[idx(x, y, z)] = T(); }
+	void clearY(const int& y) { for(size_t x = 0; x < buffer_width; x++) for(size_t z = 0; z < buffer_depth; z++) buffer_data[idx(x, y, z)] = T(); }
+	void clearZ(const int& z) { for(size_t y = 0; y < buffer_height; y++) for(size_t x = 0; x < buffer_width; x++) buffer_data[idx(x, y, z)] = T(); }
 
-	void set_size(int w, int h, int d) {
+	void set_size(size_t w, size_t h, size_t d) {
 		buffer_width = w;
 		buffer_height = h;
 		buffer_depth = d;
 	}
-	void resize(int w, int h, int d) { 
-		set_size(w, h, d);
-		//deallocate();	//Deallocated buffer memory		//NOTE: CAUSE EXCEPTION ON MALLOC DELETE
-		delete[] buffer_data; 
-		buffer_deleted = true;
-		allocate(buffer_width * buffer_height * buffer_depth);	//Allocate buffer memory	
+
+	//Discards the contents. The memory is reused when it's already big enough. Returns false, leaving an empty
+	//buffer, if the new size overflows or can't be allocated.
+	bool resize(ptrdiff_t w, ptrdiff_t h, ptrdiff_t d) { 
+		size_t _size = 0;
+		if(buffer_data != nullptr && buffer_owner && checked_size(w, h, d, _size) && _size <= buffer_capacity) {
+			set_size(std::max<ptrdiff_t>(w, 1), std::max<ptrdiff_t>(h, 1), std::max<ptrdiff_t>(d, 1));
+			clear();
+			return true;
+		}
+		deallocate();	//Deallocated buffer memory
+		return create(w, h, d);	//Allocate buffer memory	
 	}
 
+	//Resizes the width and height, keeping the contents centred. Rows and columns that no longer fit are cropped
+	//evenly from both sides and new ones are filled with t. The memory grows by at least half its capacity when it
+	//has to, so a run of small changes (e.g. dragging a window edge) only reallocates now and then; otherwise the
+	//contents are moved in place. Returns false, with the buffer unchanged, if the new size can't be allocated.
+	bool resize_centred(ptrdiff_t w, ptrdiff_t h, const T& t) {
+		w = std::max<ptrdiff_t>(w, 1);
+		h = std::max<ptrdiff_t>(h, 1);
+
+		//One axis at a time, so every element moves the same way and an in place move never overwrites unread data
+		if((size_t)w != buffer_width && !recentre(w, buffer_height, t)) return false;
+		if((size_t)h != buffer_height && !recentre(buffer_width, h, t)) return false;
+		return true;
+	}
+
+private:
+	bool recentre(ptrdiff_t w, ptrdiff_t h, const T& t) {
+		size_t _size = 0;
+		if(!checked_size(w, h, buffer_depth, _size)) return false;
+
+		//CV keeps one plane per channel, GL a single plane of interleaved pixels
+		size_t planes = (buffer_format)? buffer_depth : 1;
+		size_t pixel = (buffer_format)? 1 : buffer_depth;
+		size_t src_row = buffer_width * pixel, dst_row = w * pixel;
+		size_t src_plane = src_row * buffer_height, dst_plane = dst_row * h;
+
+		ptrdiff_t bw = buffer_width, bh = buffer_height;
+		ptrdiff_t src_x = std::max<ptrdiff_t>(0, (bw - w) / 2), src_y = std::max<ptrdiff_t>(0, (bh - h) / 2);
+		ptrdiff_t dst_x = std::max<ptrdiff_t>(0, (w - bw) / 2), dst_y = std::max<ptrdiff_t>(0, (h - bh) / 2);
+		size_t copy_w = std::min(w, bw) * pixel;
+		ptrdiff_t copy_h = std::min(h, bh);
+
+		T* src = buffer_data;
+		T* dst = buffer_data;
+		size_t old_capacity = buffer_capacity;
+		bool old_owner = buffer_owner;
+		bool grow = _size > buffer_capacity || !buffer_owner;		//A view is never resized in place
+		if(grow) {
+			T* old = buffer_data;
+			size_t step = (old_capacity / 2 <= SIZE_MAX / sizeof(T) - old_capacity)? old_capacity + old_capacity / 2 : _size;
+			if(!allocate(std::max(_size, step)) && !allocate(_size)) {
+				buffer_data = old;
+				buffer_capacity = old_capacity;
+				buffer_owner = old_owner;
+				return false;
+			}
+			dst = buffer_data;
+		}
+
+		//Growing moves every row to a higher address, so it runs backwards; shrinking runs forwards
+		bool backwards = !grow && dst_plane > src_plane;
+		for(size_t n = 0; n < planes * copy_h; n++) {
+			size_t k = (backwards)? planes * copy_h - 1 - n : n;
+			size_t z = k / copy_h, y = k % copy_h;
+			memmove(dst + z * dst_plane + (dst_y + y) * dst_row + dst_x * pixel, src + z * src_plane + (src_y + y) * src_row + src_x * pixel, copy_w * sizeof(T));
+		}
+
+		//Fill the new border around the copied block
+		for(size_t z = 0; z < planes; z++) {
+			T* plane = dst + z * dst_plane;
+			for(ptrdiff_t y = 0; y < h; y++) {
+				T* row = plane + y * dst_row;
+				if(y < dst_y || y >= dst_y + copy_h) {
+					std::fill(row, row + dst_row, t);
+					continue;
+				}
+				std::fill(row, row + dst_x * pixel, t);
+				std::fill(row + dst_x * pixel + copy_w, row + dst_row, t);
+			}
+		}
+
+		if(grow && old_owner) A::release(src, old_capacity);
+		buffer_width = w;
+		buffer_height = h;
+		return true;
+	}
+
+public:
+
+	//Takes over t, which must come from the same allocation policy (A::allocate) since the Buffer releases it
 	void link(T* t) {
 		deallocate();	//Deallocated buffer memory
-		buffer_deleted = false;
+		buffer_owner = true;
 		buffer_data = t;
+		buffer_capacity = size();
 	}
 
-	void link(T* t, int w, int h, int d) {
+	void link(T* t, size_t w, size_t h, size_t d) {
 		set_size(w, h, d);
 		link(t);
 	}
 	//-------------------------------------------------------------------------------------------------------------------------
 	
-	void format(int f) {
+	//Changes the memory layout between GL (interleaved) and CV (planar) in place. The pixels are split into blocks of
+	//c, each small enough to convert through a per-thread scratch block (BUFFER_FORMAT_BLOCK bytes); that leaves
+	//every block as d runs of c elements, and moving the runs into their planes is a transpose of an m x d matrix of
+	//runs (see buffer_transpose_runs). Going back runs the same steps in reverse. If c can't divide the pixel count
+	//the last few pixels are handled apart, at the cost of one memmove pass. threads 0 uses every core.
+	void format(int f, unsigned threads = 0) {
 
 		//Check if Buffer is already in the format
 		if( buffer_format == f ) return;
-		
-		//Create a temporary array
-		T t[buffer_width * buffer_height * buffer_depth];
-		
-		int idx = 0;
-		for(int z = 0; z < buffer_depth; z++)
-			for(int y = 0; y < buffer_height; y++)
-				for(int x = 0; x < buffer_width; x++) {
-					t[x + (y * buffer_width) + (z * buffer_width * buffer_height)] = buffer_data[idx]; 
-					idx++;
+
+		size_t n = buffer_width * buffer_height, d = buffer_depth;
+		if(buffer_data != nullptr && n > 1 && d > 1) {
+			threads = (size() < BUFFER_FORMAT_PARALLEL)? 1 : threads;
+			size_t c = format_chunk(n, std::min(n, std::max<size_t>(1, BUFFER_FORMAT_BLOCK / (sizeof(T) * d))));
+			size_t m = n / c, main = m * c, tail = n - main;
+			T* data = buffer_data;
+
+			//Converts every block through scratch
+			auto blocks = [&](bool to_planar) {
+				buffer_parallel(m, threads, [&](size_t begin, size_t end, unsigned t) {
+					std::unique_ptr<T[]> tmp(new T[c * d]);
+					for(size_t k = begin; k < end; k++) {
+						T* block = data + k * c * d;
+						buffer_relayout(block, tmp.get(), c, d, 0, c, to_planar);
+						std::copy(tmp.get(), tmp.get() + c * d, block);
+					}
+				});
+			};
+
+			std::unique_ptr<T[]> t((tail > 0)? new T[tail * d] : nullptr);
+			if(f) {
+				blocks(true);
+				buffer_transpose_runs(data, m, d, c, threads);
+
+				//The planes are packed main elements apart, spread them out and put the tail pixels on the end
+				if(tail > 0) {
+					buffer_relayout(data + main * d, t.get(), tail, d, 0, tail, true);
+					for(size_t z = d - 1; z > 0; z--) memmove(data + z * n, data + z * main, main * sizeof(T));
+					for(size_t z = 0; z < d; z++) std::copy(t.get() + z * tail, t.get() + (z + 1) * tail, data + z * n + main);
+				}
+			}
+			else {
+				if(tail > 0) {
+					for(size_t z = 0; z < d; z++) std::copy(data + z * n + main, data + (z + 1) * n, t.get() + z * tail);
+					for(size_t z = 1; z < d; z++) memmove(data + z * main, data + z * n, main * sizeof(T));
+					buffer_relayout(t.get(), data + main * d, tail, d, 0, tail, false);
 				}
 
-		//Copy the formatted temporary array to the buffer
-		for(int i = 0; i < size(); i++) 
-			buffer_data[i] = t[i];
+				buffer_transpose_runs(data, d, m, c, threads);
+				blocks(false);
+			}
+		}
 
 		//Set the format
 		buffer_format = f; 
 	}
 
+	//Writes this Buffer into buf in format f, converting straight from one layout to the other: no temporary and a
+	//single pass, split over the threads by pixel. buf takes this Buffer's size, reusing its memory when it owns
+	//enough. Returns false, leaving buf empty, if it can't be allocated.
+	template <typename B>
+	bool convert(int f, Buffer<T, B>& buf, unsigned threads = 0) const {
+		if((const void*)&buf == (const void*)this) {
+			buf.format(f, threads);
+			return true;
+		}
+		if(buffer_data == nullptr) {
+			buf.deallocate();
+			buf.set_size(0, 0, 0);
+			buf.buffer_format = f;
+			return true;
+		}
+		if(!buf.reshape(buffer_width, buffer_height, buffer_depth)) return false;
+		buf.buffer_format = f;
+
+		size_t n = buffer_width * buffer_height, d = buffer_depth;
+		if(f == buffer_format || d == 1) {
+			std::copy(buffer_data, buffer_data + size(), buf.buffer_data);
+			return true;
+		}
+
+		threads = (size() < BUFFER_FORMAT_PARALLEL)? 1 : threads;
+		buffer_parallel(n, threads, [&](size_t begin, size_t end, unsigned t) { 
+			buffer_relayout(buffer_data, buf.buffer_data, n, d, begin, end, f != 0); 
+		});
+		return true;
+	}
+
+private:
+	//Largest divisor of n up to limit, so the blocks cover every pixel. Falls back to limit itself (and a tail) when
+	//the best divisor is much smaller, since tiny blocks would make the transpose all bookkeeping.
+	static size_t format_chunk(size_t n, size_t limit) {
+		size_t best = 1;
+		for(size_t i = 1; i * i <= n && best < limit; i++) {
+			if(n % i != 0) continue;
+			if(i <= limit) best = std::max(best, i);
+			if(n / i <= limit) best = std::max(best, n / i);
+		}
+		return (best * 4 >= limit)? best : limit;
+	}
+
+	//Sets the size without touching the contents, reallocating only when the memory is too small or isn't owned
+	bool reshape(size_t w, size_t h, size_t d) {
+		size_t _size = 0;
+		if(!checked_size(w, h, d, _size)) return false;
+		if(buffer_data != nullptr && buffer_owner && _size <= buffer_capacity) {
+			set_size(w, h, d);
+			return true;
+		}
+		deallocate();
+		return create(w, h, d);
+	}
+
+	template <typename U, typename B> friend class Buffer;
+
+public:
+
 	//-------------------------------------------------------------------------------------------------------------------------
 	
-	Buffer<T> flatten() {
+	Buffer<T, A> flatten() {
 
 
 	}
@@ -317,19 +950,15 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 	
 	std::vector<T> to_vector() {
-		//std::vector<T> v = new std::vector<T>();	//Allocated on the heap
-		std::vector<T> v;	//Allocated on the stack
-		for(int i = 0; i < size(); i++)
-			v.pop_back(this(i));
-		return v;
+		return std::vector<T>(buffer_data, buffer_data + size());
 	}
 
 	//-------------------------------------------------------------------------------------------------------------------------
 	
+	//Copy of the elements on the heap. The caller owns it (delete[]).
 	T* to_array() {
-		//T* t = new T(size());		//Allocated on the heap
-		T t[size()];	//Allocated on the stack
-		for(int i = 0; i < size(); i++)
+		T* t = new T[size()];
+		for(size_t i = 0; i < size(); i++)
 			t[i] = buffer_data[i];
 		return t;
 	}
@@ -344,25 +973,24 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 
 	//Min, Max, Avg Functions
-	T max() { T m = buffer_data[0]; for(int i = 0; i < size(); i++) m = ( m >= buffer_data[i] )? m : buffer_data[i]; return m; }
-	T min() { T m = buffer_data[0]; for(int i = 0; i < size(); i++) m = ( m <= buffer_data[i] )? m : buffer_data[i]; return m; }
-	T avg() { T a = buffer_data[0]; for(int i = 0; i < size(); i++) a += buffer_data[i]; return a / size(); }
+	T max() { T m = buffer_data[0]; for(size_t i = 0; i < size(); i++) m = ( m >= buffer_data[i] )? m : buffer_data[i]; return m; }
+	T min() { T m = buffer_data[0]; for(size_t i = 0; i < size(); i++) m = ( m <= buffer_data[i] )? m : buffer_data[i]; return m; }
+	T avg() { T a = buffer_data[0]; for(size_t i = 0; i < size(); i++) a += buffer_data[i]; return a / size(); }
 	
 	//-------------------------------------------------------------------------------------------------------------------------
 	
-	//Global Mean value per channel
+	//Global Mean value per channel. The caller owns the array (delete[]).
 	T* mean() { 
-		//T* t = new T(buffer_depth);		//Is this a memory leak? Could use a Buffer<T> or std::vector instead
-		T t[buffer_depth];
-		for(int i = 0; i < buffer_depth; i++)
-			t[i] = NULL;
-
-		for(int z = 0; z < buffer_depth; z++)
-			for(int y = 0; y < buffer_height; y++)
-				for(int x = 0; x < buffer_width; x++)
+		T* t = new T[buffer_depth];
+		for(size_t i = 0; i < buffer_depth; i++)
+			t[i] = T();
+
+		for(size_t z = 0; z < buffer_depth; z++)
+			for(size_t y = 0; y < buffer_height; y++)
+				for(size_t x = 0; x < buffer_width; x++)
 					t[z] += buffer_data[idx(x, y, z)];
 
-		for(int i = 0; i < buffer_depth; i++)
+		for(size_t i = 0; i < buffer_depth; i++)
 			t[i] /= (T)buffer_width * (T)buffer_height;
 
 		return t;
@@ -371,12 +999,12 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 	
 	//Row Mean value per channel
-	Buffer<T> mean_row() { 
-		Buffer<T> t_buf = Buffer(1, buffer_height, buffer_depth, buffer_format, (T)0);
+	Buffer<T, A> mean_row() { 
+		Buffer<T, A> t_buf = Buffer(1, buffer_height, buffer_depth, buffer_format, (T)0);
 
-		for(int y = 0; y < buffer_height; y++)
-			for(int x = 0; x < buffer_width; x++)
-				for(int z = 0; z < buffer_depth; z++)
+		for(size_t y = 0; y < buffer_height; y++)
+			for(size_t x = 0; x < buffer_width; x++)
+				for(size_t z = 0; z < buffer_depth; z++)
 					t_buf(0, y, z) += buffer_data[idx(x, y, z)];
 		
 		t_buf /= (T)buffer_width;
@@ -387,12 +1015,12 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 	
 	//Column Mean value per channel
-	Buffer<T> mean_col() { 
-		Buffer<T> t_buf = Buffer(buffer_width, 1, buffer_depth, buffer_format, (T)0);
+	Buffer<T, A> mean_col() { 
+		Buffer<T, A> t_buf = Buffer(buffer_width, 1, buffer_depth, buffer_format, (T)0);
 		
-		for(int y = 0; y < buffer_height; y++)
-			for(int x = 0; x < buffer_width; x++)
-				for(int z = 0; z < buffer_depth; z++)
+		for(size_t y = 0; y < buffer_height; y++)
+			for(size_t x = 0; x < buffer_width; x++)
+				for(size_t z = 0; z < buffer_depth; z++)
 					t_buf(x, 0, z) += buffer_data[idx(x, y, z)];
 		
 		t_buf /= (T)buffer_height;
@@ -421,14 +1049,14 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 
 	//Matrix Multiply
-	Buffer<T> mult(Buffer<T>& buf) {
-		Buffer<T> t_buf(buf.width(), buffer_height, buffer_depth, buffer_format, (T)0);
+	Buffer<T, A> mult(Buffer<T, A>& buf) {
+		Buffer<T, A> t_buf(buf.width(), buffer_height, buffer_depth, buffer_format, (T)0);
 		
-		//Check matrix diminsions and create the appropriate Buffer<T>
+		//Check matrix diminsions and create the appropriate Buffer<T, A>
 		if(buffer_width != buf.height()) return t_buf;
 
 		//Multiply the buffers
-		for(int z = 0; z < buffer_depth; z++)
+		for(size_t z = 0; z < buffer_depth; z++)
 			for(int j = 0; j < t_buf.height(); j++)
 				for(int i = 0; i < t_buf.width(); i++)
 					for(int k = 0; k < buf.height(); k++)
@@ -440,12 +1068,12 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 
 	//Matrix Transpose
-	Buffer<T> transpose() {
-		Buffer<T> t_buf(buffer_height, buffer_width, buffer_depth, buffer_format);
+	Buffer<T, A> transpose() {
+		Buffer<T, A> t_buf(buffer_height, buffer_width, buffer_depth, buffer_format);
 
-		for(int y = 0; y < buffer_height; y++)
-			for(int x = 0; x < buffer_width; x++)
-				for(int z = 0; z < buffer_depth; z++)
+		for(size_t y = 0; y < buffer_height; y++)
+			for(size_t x = 0; x < buffer_width; x++)
+				for(size_t z = 0; z < buffer_depth; z++)
 					t_buf(y, x, z) = buffer_data[idx(x, y, z)];
 
 		return t_buf;
@@ -453,13 +1081,13 @@ public:
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
-	Buffer<T> adjoint() {
-		Buffer<T> t_buf(buffer_width, buffer_height, buffer_depth, buffer_format);
+	Buffer<T, A> adjoint() {
+		Buffer<T, A> t_buf(buffer_width, buffer_height, buffer_depth, buffer_format);
 
 		if (t_buf.size() == 1) 
 		{ 
 			t_buf(0,0) = 1; 
-			return NULL; 
+			return t_buf; 
 		} 
 	
 		// temp is used to store cofactors of A[][] 
@@ -514,8 +1142,8 @@ public:
 
 	//-------------------------------------------------------------------------------------------------------------------------
 	
-	Buffer<T> cofactor(int q, int p, int n) {
-		Buffer<T> t_buf(buffer_width, buffer_height, buffer_depth, buffer_format);
+	Buffer<T, A> cofactor(int q, int p, int n) {
+		Buffer<T, A> t_buf(buffer_width, buffer_height, buffer_depth, buffer_format);
 		
 		int i = 0, j = 0; 
   
@@ -546,8 +1174,8 @@ public:
 
 	//-------------------------------------------------------------------------------------------------------------------------
 	
-	Buffer<T> inverse() {
-		Buffer<T> t_buf(buffer_width, buffer_height, buffer_depth, buffer_format);
+	Buffer<T, A> inverse() {
+		Buffer<T, A> t_buf(buffer_width, buffer_height, buffer_depth, buffer_format);
 
 		// Find determinant of A[][] 
 		int det = determinant(width()); 
@@ -558,7 +1186,7 @@ public:
 		} 
 	
 		// Find adjoint 
-		Buffer<T> adj = adjoint(); 
+		Buffer<T, A> adj = adjoint(); 
 		
 		// Find Inverse using formula "inverse(A) = adj(A)/det(A)" 
 		for (int i=0; i<t_buf.height(); i++) 
@@ -573,7 +1201,7 @@ public:
 	//Standard Deviation
 	T* std_deviation() {
 		T* t = variance();
-		for(int i = 0; i < buffer_depth; i++)
+		for(size_t i = 0; i < buffer_depth; i++)
 			t[i] = sqrt(t[i]);
 
 		return t;
@@ -584,19 +1212,19 @@ public:
 	//Variance		var(x) = 1/n∑(x_i - mean_x)^2, i=1 -> n
 	T* variance() {
 		T* m = mean();
-		T* t = new T(buffer_depth);		//Is this a memory leak? Could use a Buffer<T> or std::vector instead
+		T* t = new T[buffer_depth];		//The caller owns it (delete[])
 
 		//Empty the variance array
-		for(int i = 0; i < buffer_depth; i++)
-			t[i] = NULL;
+		for(size_t i = 0; i < buffer_depth; i++)
+			t[i] = T();
 
 		//Compute the variance
-		for(int z = 0; z < buffer_depth; z++)
-			for(int y = 0; y < buffer_height; y++)
-				for(int x = 0; x < buffer_width; x++)
+		for(size_t z = 0; z < buffer_depth; z++)
+			for(size_t y = 0; y < buffer_height; y++)
+				for(size_t x = 0; x < buffer_width; x++)
 					t[z] += pow(buffer_data[idx(x, y, z)] - m[z], 2.0);
 
-		for(int i = 0; i < buffer_depth; i++)
+		for(size_t i = 0; i < buffer_depth; i++)
 			t[i] /= (T)buffer_width * (T)buffer_height;
 
 		delete[] m;	//Might need this if it is a memory leak. Either way can't hurt
@@ -609,19 +1237,19 @@ public:
 	//Covariance	cov(x,y) = 1/n∑(x_i - mean_x)(y_i - mean_y), i=1 -> n
 	T* covariance() {
 		T* m = mean();
-		T* t = new T(buffer_depth);		//Is this a memory leak? Could use a Buffer<T> or std::vector instead
-		Buffer<T> t_buf = transpose();
+		T* t = new T[buffer_depth];		//The caller owns it (delete[])
+		Buffer<T, A> t_buf = transpose();
 
 		//Empty the covariance array
-		for(int i = 0; i < buffer_depth; i++)
-			t[i] = NULL;
+		for(size_t i = 0; i < buffer_depth; i++)
+			t[i] = T();
 
-		for(int z = 0; z < buffer_depth; z++)
-			for(int y = 0; y < buffer_height; y++)
-				for(int x = 0; x < buffer_width; x++)
+		for(size_t z = 0; z < buffer_depth; z++)
+			for(size_t y = 0; y < buffer_height; y++)
+				for(size_t x = 0; x < buffer_width; x++)
 					t[z] += (buffer_data[idx(x, y, z)] - m[z]) * (t_buf(x, y, z) - m[z]);
 
-		for(int i = 0; i < buffer_depth; i++)
+		for(size_t i = 0; i < buffer_depth; i++)
 			t[i] /= (T)buffer_width * (T)buffer_height;
 
 		delete[] m;	//Might need this if it is a memory leak. Either way can't hurt
@@ -632,24 +1260,24 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 
 	//Covariance Matrix
-	Buffer<T> covariance_matrix() {
+	Buffer<T, A> covariance_matrix() {
 		/*
-		Buffer<T> ones = Buffer<T>(buffer_height, buffer_height, buffer_depth, buffer_format, 1.0f);
-		Buffer<T> c_buf = clone();
-		Buffer<T> t_buf = (c_buf / (T)c_buf.height());
+		Buffer<T, A> ones = Buffer<T, A>(buffer_height, buffer_height, buffer_depth, buffer_format, 1.0f);
+		Buffer<T, A> c_buf = clone();
+		Buffer<T, A> t_buf = (c_buf / (T)c_buf.height());
 		
 		//Standard Deviation Scores		m = M - 11`M
-		Buffer<T> std_buf = c_buf - ones.mult(t_buf);
+		Buffer<T, A> std_buf = c_buf - ones.mult(t_buf);
 
 		//Return (Deviation Score Sums of Squares)/Height	(m`m)(1/N)
-		Buffer<T> cov_buf = (std_buf.transpose().mult(std_buf)) / (T)c_buf.height();
+		Buffer<T, A> cov_buf = (std_buf.transpose().mult(std_buf)) / (T)c_buf.height();
 		*/
 
-		Buffer<T> c_buf(buffer_height * buffer_width, buffer_depth, 1, 1.0f);
+		Buffer<T, A> c_buf(buffer_height * buffer_width, buffer_depth, 1, 1.0f);
 		int idx = 0;
 
 		if(buffer_format == GL) {
-			for(int z = 0; z < buffer_depth; z++) {
+			for(size_t z = 0; z < buffer_depth; z++) {
 				idx = 0;
 				for(int i = z; i < c_buf.width(); i+=buffer_depth) {
 					c_buf(idx, z) = buffer_data[i];
@@ -658,22 +1286,22 @@ public:
 			}
 		}
 		else {
-			for(int z = 0; z < buffer_depth; z++) {
+			for(size_t z = 0; z < buffer_depth; z++) {
 				for(int i = 0; i < c_buf.width(); i++) {
 					c_buf(i, z) = buffer_data[i + z*c_buf.width()];
 				}
 			}
 		}
 
-		Buffer<T> mean_buf = c_buf.mean_row();
-		Buffer<T> std_buf = c_buf.like();
+		Buffer<T, A> mean_buf = c_buf.mean_row();
+		Buffer<T, A> std_buf = c_buf.like();
 
 		for(int y = 0; y < std_buf.height(); y++)
 			for(int x = 0; x < std_buf.width(); x++)
 				std_buf(x, y) = c_buf(x, y) - mean_buf(0, y);
 
 		//Return (Deviation Score Sums of Squares)/Height	(m`m)(1/N)
-		Buffer<T> cov_buf = (std_buf.transpose().mult(std_buf)) / (T)c_buf.height();
+		Buffer<T, A> cov_buf = (std_buf.transpose().mult(std_buf)) / (T)c_buf.height();
 
 		return cov_buf;
 	}
@@ -681,11 +1309,11 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 /*
 	//Covariance Matrix
-	Buffer<T> spectral_covariance_matrix() {
-		Buffer<T> spectral = Buffer<T>(buffer_height * buffer_width, buffer_depth, 1, 1.0f);
+	Buffer<T, A> spectral_covariance_matrix() {
+		Buffer<T, A> spectral = Buffer<T, A>(buffer_height * buffer_width, buffer_depth, 1, 1.0f);
 		int idx;
 
-		for(int z = 0; z < buffer_depth; z++) {
+		for(size_t z = 0; z < buffer_depth; z++) {
 			idx = 0;
 			for(int i = z; i < spectral.width(); i+=buffer_depth) {
 				spectral(idx, z) = buffer_data[i];
@@ -705,13 +1333,13 @@ public:
 	//-------------------------------------------------------------------------------------------------------------------------
 
 	//Euclidean
-	Buffer<T> euclidean(T* t) { 
-		Buffer<T> t_buf = like_2();
+	Buffer<T, A> euclidean(T* t) { 
+		Buffer<T, A> t_buf = like_2();
 		
-		for(int y = 0; y < buffer_height; y++)
-			for(int x = 0; x < buffer_width; x++) {
-				t_buf(x, y) = NULL;		//Clear the new buffer before using it
-				for(int z = 0; z < buffer_depth; z++)
+		for(size_t y = 0; y < buffer_height; y++)
+			for(size_t x = 0; x < buffer_width; x++) {
+				t_buf(x, y) = T();		//Clear the new buffer before using it
+				for(size_t z = 0; z < buffer_depth; z++)
 					t_buf(x, y) += pow((buffer_data[idx(x, y, z)] - t[z]), 2.0);
 				t_buf(x, y) = sqrt(t_buf(x, y));	//In-place square-root
 			}
@@ -721,13 +1349,13 @@ public:
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
-	Buffer<T> manhattan(T* t) { 
-		Buffer<T> t_buf = like_2();
+	Buffer<T, A> manhattan(T* t) { 
+		Buffer<T, A> t_buf = like_2();
 		
-		for(int y = 0; y < buffer_height; y++)
-			for(int x = 0; x < buffer_width; x++) {
-				t_buf(x, y) = NULL;		//Clear the new buffer before using it
-				for(int z = 0; z < buffer_depth; z++)
+		for(size_t y = 0; y < buffer_height; y++)
+			for(size_t x = 0; x < buffer_width; x++) {
+				t_buf(x, y) = T();		//Clear the new buffer before using it
+				for(size_t z = 0; z < buffer_depth; z++)
 					t_buf(x, y) += abs(buffer_data[idx(x, y, z)] - t[z]);
 			}
 
@@ -736,13 +1364,13 @@ public:
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
-	Buffer<T> minkowski(T* t, double p) { 	//p is the exponent
-		Buffer<T> t_buf = like_2();
+	Buffer<T, A> minkowski(T* t, double p) { 	//p is the exponent
+		Buffer<T, A> t_buf = like_2();
 
-		for(int y = 0; y < buffer_height; y++)
-			for(int x = 0; x < buffer_width; x++) {
-				t_buf(x, y) = NULL;		//Clear the new buffer before using it
-				for(int z = 0; z < buffer_depth; z++)
+		for(size_t y = 0; y < buffer_height; y++)
+			for(size_t x = 0; x < buffer_width; x++) {
+				t_buf(x, y) = T();		//Clear the new buffer before using it
+				for(size_t z = 0; z < buffer_depth; z++)
 					t_buf(x, y) += pow(abs(buffer_data[idx(x, y, z)] - t[z]), p);
 				t_buf(x, y) = pow(t_buf(x, y), 1.0/p);
 			}
@@ -762,11 +1390,11 @@ public:
 
 	std::string info() {
 		std::string rtn_str = "";
-		for(int z = 0; z < buffer_depth; z++) {
+		for(size_t z = 0; z < buffer_depth; z++) {
 			rtn_str += "[_,_," + std::to_string(z) + "]\n";
-			for(int y = 0; y < buffer_height; y++) {
+			for(size_t y = 0; y < buffer_height; y++) {
 				rtn_str += "\t";
-				for(int x = 0; x < buffer_width; x++) {
+				for(size_t x = 0; x < buffer_width; x++) {
 					rtn_str += std::to_string(buffer_data[idx(x, y, z)]) + "\t";
 				}
 				rtn_str += "\n";
@@ -782,4 +1410,176 @@ public:
 //-------------------------------------------------------------------------------------------------------------------------
 //=========================================================================================================================
 
+//A window onto part of a Buffer: a region, a channel, a tile, or a window onto one of those. It's a pointer and three
+//strides, never memory of its own, so making one costs nothing, and it's only valid while the Buffer keeps its memory
+//(until it's resized or destroyed). Copying a view copies the window; writes through it land in the Buffer.
+//Views take part in the arithmetic like Buffers (a.tile(0, 0, 64) * 2 + b.tile(1, 0, 64)), and assigning to one
+//writes its elements, so a view may appear in its own expression but not alongside another view that overlaps it.
+template <typename T>
+class BufferView {
+public:
+	typedef typename std::remove_const<T>::type value_type;
+
+private:
+	T* view_data;		//Element (0, 0, 0)
+	size_t view_width, view_height, view_depth;
+	ptrdiff_t view_x_stride, view_y_stride, view_z_stride;
+	int view_format;	//Format of the Buffer the view came from, used for Buffers made from it
+
+	//Calls f on every element, a row at a time
+	template <typename F>
+	void for_each(F f) const {
+		for(size_t z = 0; z < view_depth; z++)
+			for(size_t y = 0; y < view_height; y++) {
+				T* row = row_ptr(y, z);
+				for(size_t x = 0; x < view_width; x++) f(row[x * view_x_stride]);
+			}
+	}
+
+public:
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Constructor(s)
+	BufferView(): view_data(nullptr), view_width(0), view_height(0), view_depth(0), view_x_stride(1), view_y_stride(0), view_z_stride(0), view_format(BUFFER_FORMAT::GL) {}
+
+	BufferView(T* p, size_t w, size_t h, size_t d, ptrdiff_t sx, ptrdiff_t sy, ptrdiff_t sz, int f): view_data(p), view_width(w), view_height(h), view_depth(d), 
+			view_x_stride(sx), view_y_stride(sy), view_z_stride(sz), view_format(f) {}
+
+	//The same window, read only
+	operator BufferView<const T>() const { return BufferView<const T>(view_data, view_width, view_height, view_depth, view_x_stride, view_y_stride, view_z_stride, view_format); }
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Private variable access
+	inline T* data() const { return view_data; }
+	inline int width() const { return (int)view_width; }
+	inline int height() const { return (int)view_height; }
+	inline int depth() const { return (int)view_depth; }
+	inline int format() const { return view_format; }
+	inline size_t size() const { return view_width * view_height * view_depth; }
+	inline bool empty() const { return size() == 0; }
+	inline ptrdiff_t x_stride() const { return view_x_stride; }
+	inline ptrdiff_t y_stride() const { return view_y_stride; }
+	inline ptrdiff_t z_stride() const { return view_z_stride; }
+
+	//Laid out like a whole Buffer of the view's size, so element i is data()[i]
+	inline bool linear() const {
+		ptrdiff_t sx = (view_format)? 1 : view_depth;
+		ptrdiff_t sy = (view_format)? view_width : view_width * view_depth;
+		ptrdiff_t sz = (view_format)? view_width * view_height : 1;
+		return (view_width < 2 || view_x_stride == sx) && (view_height < 2 || view_y_stride == sy) && (view_depth < 2 || view_z_stride == sz);
+	}
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Accessing elements. Unchecked, like Buffer::at() (see BUFFER_CHECK).
+	inline bool inside(ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) const {
+		return x >= 0 && (size_t)x < view_width && y >= 0 && (size_t)y < view_height && z >= 0 && (size_t)z < view_depth;
+	}
+
+	inline T& at(ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) const { BUFFER_CHECK(inside(x, y, z)); return view_data[x * view_x_stride + y * view_y_stride + z * view_z_stride]; }
+	inline T& operator() (ptrdiff_t x, ptrdiff_t y, ptrdiff_t z) const { return at(x, y, z); }
+	inline T& operator() (ptrdiff_t x, ptrdiff_t y) const { return at(x, y, 0); }
+
+	inline T* row_ptr(ptrdiff_t y, ptrdiff_t z) const { BUFFER_CHECK(inside(0, y, z)); return view_data + y * view_y_stride + z * view_z_stride; }
+	inline buffer_span<T> row(ptrdiff_t y, ptrdiff_t z) const { return buffer_span<T>(row_ptr(y, z), view_width, view_x_stride); }
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//The w x h region at (x, y) in every channel, cropped to the view (so it can come out empty)
+	BufferView<T> region(ptrdiff_t x, ptrdiff_t y, ptrdiff_t w, ptrdiff_t h) const {
+		ptrdiff_t vw = view_width, vh = view_height;
+		ptrdiff_t x0 = std::min(std::max<ptrdiff_t>(x, 0), vw), x1 = std::min(std::max<ptrdiff_t>(x + w, x0), vw);
+		ptrdiff_t y0 = std::min(std::max<ptrdiff_t>(y, 0), vh), y1 = std::min(std::max<ptrdiff_t>(y + h, y0), vh);
+		T* p = (x1 > x0 && y1 > y0)? view_data + x0 * view_x_stride + y0 * view_y_stride : view_data;
+		return BufferView<T>(p, x1 - x0, y1 - y0, view_depth, view_x_stride, view_y_stride, view_z_stride, view_format);
+	}
+
+	//Channel z on its own
+	BufferView<T> channel(ptrdiff_t z) const {
+		if(z < 0 || (size_t)z >= view_depth) return BufferView<T>(view_data, view_width, view_height, 0, view_x_stride, view_y_stride, view_z_stride, view_format);
+		return BufferView<T>(view_data + z * view_z_stride, view_width, view_height, 1, view_x_stride, view_y_stride, view_z_stride, view_format);
+	}
+
+	//Tile (tx, ty) of a grid of size x size tiles. Tiles along the right and top edges can be smaller.
+	BufferView<T> tile(ptrdiff_t tx, ptrdiff_t ty, ptrdiff_t size) const { return region(tx * size, ty * size, size, size); }
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Min, Max and Count. An empty view gives a default value.
+	value_type max() const { 
+		if(empty()) return value_type(); 
+		value_type m = *view_data; 
+		for_each([&](const T& v) { m = (m >= v)? m : v; }); 
+		return m; 
+	}
+
+	value_type min() const { 
+		if(empty()) return value_type(); 
+		value_type m = *view_data; 
+		for_each([&](const T& v) { m = (m <= v)? m : v; }); 
+		return m; 
+	}
+
+	//Number of elements equal to t (e.g. the live cells in a tile)
+	size_t count(const value_type& t) const { size_t n = 0; for_each([&](const T& v) { n += (v == t); }); return n; }
+
+	//Mean value per channel. The caller owns the array (delete[]).
+	value_type* mean() const {
+		value_type* t = new value_type[view_depth];
+		for(size_t z = 0; z < view_depth; z++) {
+			t[z] = value_type();
+			channel(z).for_each([&](const T& v) { t[z] += v; });
+			t[z] /= (value_type)view_width * (value_type)view_height;
+		}
+		return t;
+	}
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	void clear(const value_type& t) { for_each([&](T& v) { v = t; }); }
+
+	//Deep copy into a Buffer that owns its memory, in the format of the Buffer the view came from
+	Buffer<value_type> clone() const { return Buffer<value_type>(buffer_leaf<value_type>(*this)); }
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Writes a Buffer, another view or an expression into the view, element for element. Nothing is written and false
+	//is returned if the shapes differ, a view never resizes anything.
+	template <typename X>
+	typename std::enable_if<buffer_operand<X>::value, bool>::type copy_from(const X& x) { return assign(buffer_operand<X>::get(x)); }
+
+	template <typename E>
+	BufferView<T>& operator = (const buffer_expr<E>& expr) { 
+		assign(expr.self()); 
+		return *this; 
+	}
+
+	template <typename X> typename std::enable_if<buffer_operand<X>::value>::type operator += (const X& x) { assign(*this + x); }
+	template <typename X> typename std::enable_if<buffer_operand<X>::value>::type operator -= (const X& x) { assign(*this - x); }
+	template <typename X> typename std::enable_if<buffer_operand<X>::value>::type operator *= (const X& x) { assign(*this * x); }
+	template <typename X> typename std::enable_if<buffer_operand<X>::value>::type operator /= (const X& x) { assign(*this / x); }
+
+	inline void operator += (const value_type& t) { assign(*this + t); }
+	inline void operator -= (const value_type& t) { assign(*this - t); }
+	inline void operator *= (const value_type& t) { assign(*this * t); }
+	inline void operator /= (const value_type& t) { assign(*this / t); }
+
+private:
+	template <typename E>
+	bool assign(const E& expr) {
+		if(expr.width != view_width || expr.height != view_height || expr.depth != view_depth) return false;
+		for(size_t z = 0; z < view_depth; z++)
+			for(size_t y = 0; y < view_height; y++) {
+				T* out = row_ptr(y, z);
+				for(size_t x = 0; x < view_width; x++) out[x * view_x_stride] = expr.at(x, y, z);
+			}
+		return true;
+	}
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
 #endif
\ No newline at end of file
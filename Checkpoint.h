@@ -0,0 +1,174 @@
+/*
+Checkpoint class -- Background snapshot writer so periodic checkpoints don't stall the simulation
+Developed by: Travis Stewart
+*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "Snapshot.h"
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#define CHECKPOINT_SLOTS 2		//Captured boards that can wait for the writer before checkpoints are skipped
+
+//The simulation copies the board into a free slot at a generation boundary (one memcpy) and carries on.
+//The writer thread packs the copy and streams it to disk, then deletes checkpoints past the retention count.
+class checkpoint_writer {
+private:
+	struct checkpoint_slot {
+		std::vector<char> cells;		//One byte per cell, a copy of a contiguous bool plane
+		uint64_t width = 0, height = 0, generation = 0;
+		int birth = 0, survive = 0;
+		bool full = false;
+	};
+
+	checkpoint_slot slots[CHECKPOINT_SLOTS];
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::thread worker;
+	bool running = false;
+	std::deque<std::string> written;	//Oldest first, for retention
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mtx);
+		while(true) {
+			int s = -1;
+			for(int i = 0; i < CHECKPOINT_SLOTS; i++) if(slots[i].full && (s < 0 || slots[i].generation < slots[s].generation)) s = i;
+			if(s < 0) {
+				if(!running) return;
+				cv.wait(lock);
+				continue;
+			}
+
+			//The slot belongs to this thread until it's marked empty again
+			lock.unlock();
+			write(slots[s]);
+			lock.lock();
+			slots[s].full = false;
+		}
+	}
+
+	void write(const checkpoint_slot& slot) {
+		char name[64];
+		snprintf(name, sizeof(name), "checkpoint_%012llu.snap", (unsigned long long)slot.generation);
+		std::string file_name = directory + "/" + name;
+		std::string tmp_name = file_name + ".tmp";
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+		snapshot_writer writer;
+		bool saved = writer.open(tmp_name.c_str(), slot.width, slot.height, slot.birth, slot.survive, slot.generation, direct_io);
+		if(saved) {
+			std::vector<uint64_t> words(writer.row_words());
+			const bool* cells = (const bool*)slot.cells.data();
+			for(uint64_t j = 0; j < slot.height; j++) {
+				packRow(cells + j * slot.width, 1, slot.width, words.data(), words.size());
+				writer.write_row(words.data());
+			}
+			saved = writer.close();
+		}
+
+		//Only complete files get the real name, so a crash mid-write never leaves a corrupt checkpoint behind
+		if(saved) saved = rename(tmp_name.c_str(), file_name.c_str()) == 0;
+		else remove(tmp_name.c_str());
+
+		write_time_ns += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+
+		if(!saved) {
+			failed++;
+			printf("Failed to write checkpoint | %s\n", file_name.c_str());
+			return;
+		}
+
+		completed++;
+		written.push_back(file_name);
+		while(keep > 0 && (int)written.size() > keep) {
+			remove(written.front().c_str());
+			written.pop_front();
+		}
+	}
+
+public:
+	//Configuration. Set before start().
+	int interval = 0;				//Generations between checkpoints, 0 disables them
+	int keep = 3;					//Newest checkpoints kept on disk, 0 keeps all
+	std::string directory = ".";
+	bool direct_io = true;			//Bypass the page cache where supported
+
+	//Statistics
+	std::atomic<int> completed{0};
+	std::atomic<int> skipped{0};	//Captures dropped because the writer was still busy with every slot
+	std::atomic<int> failed{0};
+	std::atomic<uint64_t> write_time_ns{0};	//Total time spent packing and writing
+
+	~checkpoint_writer() { stop(); }
+
+	inline bool enabled() const { return interval > 0; }
+	inline bool due(uint64_t generation) const { return interval > 0 && generation % interval == 0; }
+
+	void start() {
+		std::lock_guard<std::mutex> lock(mtx);
+		if(running || interval <= 0) return;
+		running = true;
+		worker = std::thread(&checkpoint_writer::run, this);
+	}
+
+	//Writes whatever has been captured, then joins the writer
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if(!running) return;
+			running = false;
+		}
+		cv.notify_all();
+		if(worker.joinable()) worker.join();
+	}
+
+	//Copies a contiguous width x height plane of cells. Call while the plane can't change (e.g. inside the generation
+	//barrier). Never blocks on disk; returns false and counts a skip if both slots are still being written.
+	bool capture(const bool* plane, uint64_t width, uint64_t height, int birth, int survive, uint64_t generation) {
+		std::unique_lock<std::mutex> lock(mtx);
+		if(!running) return false;
+
+		int s = -1;
+		for(int i = 0; i < CHECKPOINT_SLOTS && s < 0; i++) if(!slots[i].full) s = i;
+		if(s < 0) {
+			skipped++;
+			return false;
+		}
+
+		checkpoint_slot& slot = slots[s];
+		slot.cells.resize(width * height);
+		memcpy(slot.cells.data(), plane, width * height);
+		slot.width = width;
+		slot.height = height;
+		slot.generation = generation;
+		slot.birth = birth;
+		slot.survive = survive;
+		slot.full = true;
+
+		lock.unlock();
+		cv.notify_one();
+		return true;
+	}
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
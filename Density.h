@@ -0,0 +1,113 @@
+/*
+Density pyramid class -- Hierarchical live cell density of the board, updated one tile at a time for zoomed out views
+Developed by: Travis Stewart
+*/
+
+#ifndef DENSITY_H
+#define DENSITY_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//Level k (k >= 1) holds one byte per 2^k x 2^k block of cells, 0 for empty up to 255 for full. Level 1 is counted
+//from the cells and every level above is the average of the 2 x 2 blocks below it. Blocks past the board edge count
+//as dead. The top level is a single entry.
+//
+//The board is split into square tiles (a power of two in size). update_tile() rebuilds every level inside one tile,
+//up to the level where the tile is a single entry, and update_parents() rebuilds the entries above it, so keeping
+//the pyramid current only costs work for the tiles that changed.
+class density_pyramid {
+private:
+	std::vector< std::vector<uint8_t> > levels;		//levels[0] is unused, level 0 is the board itself
+	std::vector<int> widths, heights;
+	int width = 0, height = 0;						//Board size in cells
+	int tile_size = 0;
+	int tile_level = 0;								//Level where a tile is one entry
+
+	//Entry of level k, 0 past the edge
+	inline int entry(int k, int x, int y) const {
+		return (x < widths[k] && y < heights[k])? levels[k][(size_t)y * widths[k] + x] : 0;
+	}
+
+	inline void average(int k, int x, int y) {
+		int sum = entry(k - 1, 2 * x, 2 * y) + entry(k - 1, 2 * x + 1, 2 * y) + entry(k - 1, 2 * x, 2 * y + 1) + entry(k - 1, 2 * x + 1, 2 * y + 1);
+		levels[k][(size_t)y * widths[k] + x] = (uint8_t)((sum + 2) / 4);
+	}
+
+public:
+	inline int num_levels() const { return (int)levels.size(); }
+	inline int level_width(int k) const { return widths[k]; }
+	inline int level_height(int k) const { return heights[k]; }
+	inline const uint8_t* level(int k) const { return levels[k].data(); }
+	inline int board_width() const { return width; }
+	inline int board_height() const { return height; }
+
+	//Sizes the levels for a w x h board split into tile x tile tiles (tile must be a power of two). Every entry is zeroed.
+	void resize(int w, int h, int tile) {
+		width = w;
+		height = h;
+		tile_size = tile;
+		for(tile_level = 0; (1 << tile_level) < tile; tile_level++);
+
+		levels.assign(1, std::vector<uint8_t>());
+		widths.assign(1, w);
+		heights.assign(1, h);
+		while(widths.back() > 1 || heights.back() > 1) {
+			widths.push_back((widths.back() + 1) / 2);
+			heights.push_back((heights.back() + 1) / 2);
+			levels.push_back(std::vector<uint8_t>((size_t)widths.back() * heights.back(), 0));
+		}
+	}
+
+	//Rebuilds the levels inside tile (tx, ty). plane is the contiguous width x height board, one bool per cell.
+	void update_tile(const bool* plane, int tx, int ty) {
+		for(int k = 1; k < num_levels() && k <= tile_level; k++) {
+			int x0 = (tx * tile_size) >> k, x1 = std::min(((tx + 1) * tile_size) >> k, widths[k]);
+			int y0 = (ty * tile_size) >> k, y1 = std::min(((ty + 1) * tile_size) >> k, heights[k]);
+
+			for(int y = y0; y < y1; y++) {
+				uint8_t* row = levels[k].data() + (size_t)y * widths[k];
+				if(k > 1) {
+					for(int x = x0; x < x1; x++) average(k, x, y);
+					continue;
+				}
+
+				//Level 1 counts the cells, the second row and column may fall off the board
+				const bool* c0 = plane + (size_t)(2 * y) * width;
+				const bool* c1 = (2 * y + 1 < height)? c0 + width : nullptr;
+				for(int x = x0; x < x1; x++) {
+					int n = c0[2 * x] + ((c1 != nullptr)? c1[2 * x] : 0);
+					if(2 * x + 1 < width) n += c0[2 * x + 1] + ((c1 != nullptr)? c1[2 * x + 1] : 0);
+					row[x] = (uint8_t)((n * 255 + 2) / 4);
+				}
+			}
+		}
+	}
+
+	//Rebuilds the entries above the tile level that cover tile (tx, ty). Call after update_tile().
+	void update_parents(int tx, int ty) {
+		for(int k = tile_level + 1; k < num_levels(); k++) average(k, tx >> (k - tile_level), ty >> (k - tile_level));
+	}
+
+	//Rebuilds every level from the board
+	void rebuild(const bool* plane) {
+		int tiles_x = (width + tile_size - 1) / tile_size, tiles_y = (height + tile_size - 1) / tile_size;
+		for(int ty = 0; ty < tiles_y; ty++) for(int tx = 0; tx < tiles_x; tx++) update_tile(plane, tx, ty);
+		for(int k = tile_level + 1; k < num_levels(); k++) {
+			for(int y = 0; y < heights[k]; y++) for(int x = 0; x < widths[k]; x++) average(k, x, y);
+		}
+	}
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
@@ -0,0 +1,216 @@
+/*
+Frame export class -- Streams generations as raw 8-bit Y4M or PGM frames to a file or pipe on a background thread
+Developed by: Travis Stewart
+*/
+
+#ifndef FRAME_EXPORT_H
+#define FRAME_EXPORT_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#define FRAME_EXPORT_FILE_BUFFER (4 << 20)		//stdio buffer for the output file or pipe
+
+enum FRAME_FORMAT{ FRAME_Y4M=0, FRAME_PGM=1 };
+
+//popen/pclose are POSIX; the Windows CRT has _popen/_pclose, and needs binary mode asked for explicitly
+inline FILE* frameOpenPipe(const char* command) {
+#if defined(_WIN32)
+	return _popen(command, "wb");
+#else
+	return popen(command, "w");
+#endif
+}
+
+//Returns the command's exit status, or -1 if it couldn't be collected
+inline int frameClosePipe(FILE* pipe) {
+#if defined(_WIN32)
+	return _pclose(pipe);
+#else
+	return pclose(pipe);
+#endif
+}
+
+//Output formats, both 1 byte per pixel with live cells at 255:
+//	Y4M		YUV4MPEG2 stream with the Cmono colourspace, readable by ffmpeg/x264 straight from a pipe
+//	PGM		Concatenated binary (P5) greymaps, for image2pipe style readers
+//The file name picks the format (".pgm" for PGM, anything else Y4M). "|command" pipes the frames into command,
+//e.g. "|ffmpeg -i - -c:v libx264 run.mp4".
+class frame_exporter {
+private:
+	struct frame_slot {
+		std::vector<char> cells;		//One byte per cell, rows top to bottom
+		uint64_t generation = 0;
+	};
+
+	std::vector<frame_slot> slots;
+	size_t head = 0, count = 0;			//Oldest captured slot and number waiting
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::thread worker;
+	bool running = false;
+
+	FILE* file = nullptr;
+	bool is_pipe = false;
+	std::vector<char> file_buffer;
+	std::vector<uint8_t> pixels;		//Reused output frame, only touched by the worker
+	int format = FRAME_Y4M;
+	uint64_t width = 0, height = 0;		//Board size in cells
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mtx);
+		while(true) {
+			if(count == 0) {
+				if(!running) return;
+				cv.wait(lock);
+				continue;
+			}
+
+			//The slot belongs to this thread until it's released
+			frame_slot& slot = slots[head];
+			lock.unlock();
+			write(slot);
+			lock.lock();
+			head = (head + 1) % slots.size();
+			count--;
+		}
+	}
+
+	//Expands each cell into a scale x scale block of 0 or 255 and writes the frame
+	void write(const frame_slot& slot) {
+		if(failed) return;
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+		size_t out_width = width * scale;
+		for(uint64_t j = 0; j < height; j++) {
+			const char* cells = slot.cells.data() + j * width;
+			uint8_t* row = pixels.data() + j * scale * out_width;
+			if(scale == 1) for(uint64_t i = 0; i < width; i++) row[i] = (uint8_t)(-cells[i]);
+			else {
+				for(uint64_t i = 0; i < width; i++) memset(row + i * scale, (uint8_t)(-cells[i]), scale);
+				for(int r = 1; r < scale; r++) memcpy(row + r * out_width, row, out_width);
+			}
+		}
+
+		int header = (format == FRAME_Y4M)? fputs("FRAME\n", file) : fprintf(file, "P5\n%zu %zu\n255\n", out_width, (size_t)(height * scale));
+		if(header < 0 || fwrite(pixels.data(), 1, pixels.size(), file) != pixels.size()) failed = true;
+
+		frames++;
+		written_bytes += pixels.size();
+		write_time_ns += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+	}
+
+public:
+	//Configuration. Set before open().
+	int every = 1;					//Generations between exported frames
+	int scale = 1;					//Output pixels per cell along each axis
+	int fps = 30;					//Frame rate written to the Y4M header
+	int queue_depth = 8;			//Captured frames that can wait for the writer before frames are dropped
+
+	//Statistics
+	std::atomic<uint64_t> frames{0};
+	std::atomic<uint64_t> dropped{0};			//Frames not exported because the queue was full
+	std::atomic<uint64_t> written_bytes{0};
+	std::atomic<uint64_t> write_time_ns{0};
+	std::atomic<bool> failed{false};
+
+	~frame_exporter() { close(); }
+
+	inline bool is_open() const { return file != nullptr; }
+	inline bool due(uint64_t generation) const { return file != nullptr && generation % every == 0; }
+
+	//Opens the output for a width x height board. All buffers are allocated here, none per frame. Fails if a scaled
+	//frame's size doesn't fit in size_t.
+	bool open(const std::string& name, uint64_t w, uint64_t h) {
+		close();
+		every = (every > 0)? every : 1;
+		scale = (scale > 0)? scale : 1;
+
+		uint64_t scale_sq = (uint64_t)scale * scale;
+		if(w == 0 || h == 0 || w > SIZE_MAX / h || w * h > SIZE_MAX / scale_sq) return false;
+
+		is_pipe = name.size() > 1 && name[0] == '|';
+		file = (is_pipe)? frameOpenPipe(name.c_str() + 1) : fopen(name.c_str(), "wb");
+		if(file == nullptr) return false;
+
+		file_buffer.resize(FRAME_EXPORT_FILE_BUFFER);
+		setvbuf(file, file_buffer.data(), _IOFBF, file_buffer.size());
+
+		format = (name.size() > 4 && name.compare(name.size() - 4, 4, ".pgm") == 0)? FRAME_PGM : FRAME_Y4M;
+		width = w;
+		height = h;
+		pixels.assign(width * height * scale * scale, 0);
+		failed = false;
+		if(format == FRAME_Y4M && fprintf(file, "YUV4MPEG2 W%llu H%llu F%i:1 Ip A1:1 Cmono\n", (unsigned long long)(width * scale), (unsigned long long)(height * scale), fps) < 0) failed = true;
+
+		slots.assign((queue_depth > 0)? queue_depth : 1, frame_slot());
+		for(size_t s = 0; s < slots.size(); s++) slots[s].cells.resize(width * height);
+		head = count = 0;
+
+		running = true;
+		worker = std::thread(&frame_exporter::run, this);
+		return true;
+	}
+
+	//Copies a contiguous width x height plane of cells. Call while the plane can't change (e.g. inside the generation
+	//barrier). Row 0 is the bottom of the board, so rows are flipped on the way in. Never blocks on the writer; the
+	//frame is dropped if every slot is still queued, or if the board no longer matches the output size.
+	bool capture(const bool* plane, uint64_t w, uint64_t h, uint64_t generation) {
+		std::unique_lock<std::mutex> lock(mtx);
+		if(!running || w != width || h != height) return false;
+
+		if(count == slots.size()) {
+			dropped++;
+			return false;
+		}
+
+		frame_slot& slot = slots[(head + count) % slots.size()];
+		for(uint64_t j = 0; j < height; j++) memcpy(slot.cells.data() + (height - 1 - j) * width, plane + j * width, width);
+		slot.generation = generation;
+		count++;
+
+		lock.unlock();
+		cv.notify_one();
+		return true;
+	}
+
+	//Writes every captured frame, then closes the output. A failed flush, close, or a pipe command that exits with an
+	//error all set failed.
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if(!running) return;
+			running = false;
+		}
+		cv.notify_all();
+		if(worker.joinable()) worker.join();
+
+		if(fflush(file) != 0) failed = true;
+		if(is_pipe) {
+			if(frameClosePipe(file) != 0) failed = true;
+		}
+		else if(fclose(file) != 0) failed = true;
+		file = nullptr;
+	}
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
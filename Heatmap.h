@@ -0,0 +1,108 @@
+/*
+Heatmap functions -- Saturating per-cell age planes and the colour ramp used to draw them
+Developed by: Travis Stewart
+*/
+
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//A cell's age is the number of generations since it last changed, saturating at HEAT_AGE_MAX. Together with the cell
+//itself it says how long a live cell has been alive, or how long ago a dead one died.
+#define HEAT_AGE_MAX 255
+#define HEAT_PALETTE_SIZE 256		//Colour index entries: 128 for dead cells by age, then 128 for live ones
+
+//Next age of n cells: 0 where the cell differs between cur and next, otherwise one more. Cells are 0/1 bytes.
+//16 cells per instruction with SSE2 or NEON, so it adds one streaming pass per row to the step.
+inline void ageRow(const bool* cur, const bool* next, const uint8_t* age, uint8_t* out, size_t n) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	const __m128i one = _mm_set1_epi8(1);
+	for(; i + 16 <= n; i += 16) {
+		__m128i same = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(cur + i)), _mm_loadu_si128((const __m128i*)(next + i)));
+		__m128i older = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(age + i)), one);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_and_si128(older, same));
+	}
+#elif defined(__ARM_NEON)
+	const uint8x16_t one = vdupq_n_u8(1);
+	for(; i + 16 <= n; i += 16) {
+		uint8x16_t same = vceqq_u8(vld1q_u8((const uint8_t*)cur + i), vld1q_u8((const uint8_t*)next + i));
+		vst1q_u8(out + i, vandq_u8(vqaddq_u8(vld1q_u8(age + i), one), same));
+	}
+#endif
+	for(; i < n; i++) out[i] = (cur[i] != next[i])? 0 : (uint8_t)(age[i] + (age[i] < HEAT_AGE_MAX));
+}
+
+//Colour index of a cell in the heatmap palette
+inline uint8_t heatIndex(bool alive, uint8_t age) { return (uint8_t)(((alive)? 128 : 0) + (age >> 1)); }
+
+//Heatmap colour indices for n cells. The output is usually a mapped pixel buffer that is only written, so the SSE2
+//path uses streaming stores once out is aligned, fenced before returning.
+inline void heatRow(const bool* cells, const uint8_t* age, uint8_t* out, size_t n) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	for(; i < n && ((uintptr_t)(out + i) & 15) != 0; i++) out[i] = heatIndex(cells[i], age[i]);
+	const __m128i low = _mm_set1_epi8(0x7F), high = _mm_set1_epi8((char)0x80);
+	for(; i + 16 <= n; i += 16) {
+		__m128i a = _mm_and_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i*)(age + i)), 1), low);
+		__m128i c = _mm_and_si128(_mm_slli_epi16(_mm_loadu_si128((const __m128i*)(cells + i)), 7), high);
+		_mm_stream_si128((__m128i*)(out + i), _mm_or_si128(a, c));
+	}
+	_mm_sfence();
+#elif defined(__ARM_NEON)
+	for(; i + 16 <= n; i += 16) {
+		uint8x16_t a = vshrq_n_u8(vld1q_u8(age + i), 1);
+		uint8x16_t c = vshlq_n_u8(vld1q_u8((const uint8_t*)cells + i), 7);
+		vst1q_u8(out + i, vorrq_u8(a, c));
+	}
+#endif
+	for(; i < n; i++) out[i] = heatIndex(cells[i], age[i]);
+}
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Colour of heatmap palette entry i. Live cells run from white when born through yellow and orange to a dark red once
+//they've been stable for HEAT_AGE_MAX generations, so oscillators and active regions stand out. Dead cells leave a
+//blue trail that fades back to the dead colour over a few dozen generations.
+inline void heatColor(int i, const float* dead_color, float* rgb) {
+	static const float stops[][4] = {		//Age fraction, r, g, b
+		{ 0.00f, 1.0f, 1.0f, 1.0f },
+		{ 0.02f, 1.0f, 1.0f, 0.2f },
+		{ 0.15f, 1.0f, 0.5f, 0.0f },
+		{ 1.00f, 0.4f, 0.0f, 0.1f }
+	};
+	float t = (i & 127) / 127.0f;
+
+	if(i < 128) {
+		static const float trail[3] = { 0.1f, 0.3f, 1.0f };
+		float glow = 0.6f * expf(-t * HEAT_AGE_MAX / 12.0f);
+		for(int c = 0; c < 3; c++) rgb[c] = dead_color[c] + glow * (trail[c] - dead_color[c]);
+		return;
+	}
+
+	int s = 1;
+	while(s < 3 && t > stops[s][0]) s++;
+	float f = (t - stops[s - 1][0]) / (stops[s][0] - stops[s - 1][0]);
+	for(int c = 0; c < 3; c++) rgb[c] = stops[s - 1][c + 1] + f * (stops[s][c + 1] - stops[s - 1][c + 1]);
+}
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
@@ -0,0 +1,226 @@
+/*
+Macrocell class -- Golly macrocell (.mc) hashed quadtree pattern reader and writer
+Developed by: Travis Stewart
+*/
+
+#ifndef MACROCELL_H
+#define MACROCELL_H
+
+#include "Pattern.h"
+#include <functional>
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#define MC_LEAF_LEVEL 3		//Two-state macrocell files store 8x8 leaves
+
+//Quadtree node. Index 0 is the shared empty node of every level.
+struct mc_node {
+	int level;				//Node covers 2^level x 2^level cells
+	uint32_t child[4];		//nw, ne, sw, se (cell states for level 1 nodes)
+	uint64_t leaf;			//Level 3 bits, bit (row * 8 + col) with row 0 at the top
+	long long population;
+};
+
+class macrocell {
+private:
+	vector<mc_node> nodes;
+	uint32_t root;
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Emits the live runs of one leaf row. Clipping is done by the caller's span function.
+	template <class F>
+	static inline void leafSpans(uint64_t bits, long long x, long long y, F& span) {
+		for(int r = 0; r < 8; r++) {
+			unsigned int row = (bits >> (r * 8)) & 0xFF;
+			int c = 0;
+			while(row) {
+				int skip = __builtin_ctz(row);
+				row >>= skip;
+				c += skip;
+				int run = __builtin_ctz(~row);
+				span(x + c, y + r, (long long)run);
+				row = (run >= 8)? 0 : row >> run;
+				c += run;
+			}
+		}
+	}
+
+	template <class F>
+	void nodeSpans(uint32_t idx, long long x, long long y, long long cx, long long cy, long long cw, long long ch, F& span) const {
+		if(idx == 0) return;
+		const mc_node& n = nodes[idx];
+		long long size = 1LL << n.level;
+
+		//Skip nodes that don't touch the clip rectangle
+		if(x >= cx + cw || y >= cy + ch || x + size <= cx || y + size <= cy) return;
+
+		if(n.level == MC_LEAF_LEVEL && n.leaf != 0) { leafSpans(n.leaf, x, y, span); return; }
+		if(n.level == 1) {
+			for(int q = 0; q < 4; q++) if(n.child[q]) span(x + (q & 1), y + (q >> 1), 1LL);
+			return;
+		}
+
+		long long half = size / 2;
+		for(int q = 0; q < 4; q++) nodeSpans(n.child[q], x + (q & 1) * half, y + (q >> 1) * half, cx, cy, cw, ch, span);
+	}
+
+public:
+	pattern_info info;		//width/height are the root size, plus the #R rule and #G generation
+
+	macrocell(): root(0) { clear(); }
+
+	void clear() {
+		nodes.clear();
+		mc_node empty = { 0, { 0, 0, 0, 0 }, 0, 0 };
+		nodes.push_back(empty);
+		root = 0;
+		info = pattern_info();
+	}
+
+	inline size_t num_nodes() const { return nodes.size() - 1; }
+	inline long long population() const { return nodes[root].population; }
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Reads the node table line by line. Time and memory are proportional to the number of unique nodes, not the area.
+	bool read(const char* file_name) {
+		FILE* file = fopen(file_name, "rb");
+		if(file == nullptr) return false;
+		clear();
+
+		char line[1024];
+		bool valid = true;
+		while(valid && fgets(line, sizeof(line), file) != nullptr) {
+			char c = line[0];
+			if(c == '[' || c == '\n' || c == '\r') continue;
+
+			if(c == '#') {
+				if(line[1] == 'R') info.has_rule = parseRule(string(line + 2), info.rule);
+				else if(line[1] == 'G') info.generation = atoll(line + 2);
+				continue;
+			}
+
+			mc_node n = { 0, { 0, 0, 0, 0 }, 0, 0 };
+
+			//8x8 leaf: '.' dead, '*' alive, '$' end of row
+			if(c == '.' || c == '*' || c == '$') {
+				int r = 0, col = 0;
+				for(char* p = line; *p && *p != '\n' && *p != '\r'; p++) {
+					if(*p == '$') { r++; col = 0; }
+					else {
+						if(*p == '*' && r < 8 && col < 8) n.leaf |= 1ull << (r * 8 + col);
+						col++;
+					}
+				}
+				n.level = MC_LEAF_LEVEL;
+				n.population = __builtin_popcountll(n.leaf);
+			}
+			//Internal node: level nw ne sw se
+			else {
+				unsigned int nw, ne, sw, se;
+				if(sscanf(line, "%i %u %u %u %u", &n.level, &nw, &ne, &sw, &se) != 5 || n.level < 1 || n.level > 62) { valid = false; break; }
+
+				uint32_t child[4] = { nw, ne, sw, se };
+				for(int q = 0; q < 4; q++) {
+					n.child[q] = child[q];
+					if(n.level == 1) { n.population += (child[q] != 0); continue; }
+					if(child[q] >= nodes.size() || (child[q] != 0 && nodes[child[q]].level != n.level - 1)) { valid = false; break; }
+					n.population += nodes[child[q]].population;
+				}
+			}
+
+			nodes.push_back(n);
+		}
+		fclose(file);
+
+		if(!valid || nodes.size() < 2) { clear(); return false; }
+
+		root = (uint32_t)nodes.size() - 1;
+		info.width = info.height = 1LL << nodes[root].level;
+		return true;
+	}
+
+	//Calls span(x, y, length) for the live runs inside the clip rectangle, in root coordinates (y down)
+	template <class F>
+	void spans(long long clip_x, long long clip_y, long long clip_w, long long clip_h, F span) const {
+		nodeSpans(root, 0, 0, clip_x, clip_y, clip_w, clip_h, span);
+	}
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Builds a hashed quadtree of a width x height region, where cell(x, y) returns whether a cell is alive (y down),
+	//and streams it out. Identical subtrees are written once, each node right after its children. Returns false if
+	//any write failed (e.g. the disk is full).
+	template <class F>
+	static bool write(const char* file_name, long long width, long long height, const pattern_rule& rule, long long generation, F cell) {
+		FILE* file = fopen(file_name, "wb");
+		if(file == nullptr) return false;
+
+		//The root is always an internal node, even for a board that fits in one leaf
+		int level = MC_LEAF_LEVEL + 1;
+		while((1LL << level) < width || (1LL << level) < height) level++;
+
+		bool failed = fprintf(file, "[M2] (Game of Life Simulation)\n#R %s\n#G %lld\n", ruleString(rule).c_str(), generation) < 0;
+
+		unordered_map<uint64_t, uint32_t> leaves;
+		map<vector<uint32_t>, uint32_t> internal;
+		uint32_t next_idx = 1;
+
+		//Recursive builder. Returns the node index, 0 for empty.
+		std::function<uint32_t(int, long long, long long)> build = [&](int lvl, long long x, long long y) -> uint32_t {
+			if(x >= width || y >= height) return 0;
+
+			if(lvl == MC_LEAF_LEVEL) {
+				uint64_t bits = 0;
+				for(int r = 0; r < 8 && y + r < height; r++)
+					for(int c = 0; c < 8 && x + c < width; c++)
+						if(cell(x + c, y + r)) bits |= 1ull << (r * 8 + c);
+				if(bits == 0) return 0;
+
+				auto found = leaves.find(bits);
+				if(found != leaves.end()) return found->second;
+
+				//Rows up to the last live cell, trailing dead cells and rows dropped
+				string s = "";
+				int last_row = 7;
+				while(((bits >> (last_row * 8)) & 0xFF) == 0) last_row--;
+				for(int r = 0; r <= last_row; r++) {
+					unsigned int row = (bits >> (r * 8)) & 0xFF;
+					for(int c = 0; row >> c; c++) s += ((row >> c) & 1)? '*' : '.';
+					s += '$';
+				}
+				if(fprintf(file, "%s\n", s.c_str()) < 0) failed = true;
+				leaves[bits] = next_idx;
+				return next_idx++;
+			}
+
+			long long half = 1LL << (lvl - 1);
+			vector<uint32_t> key = { (uint32_t)lvl, build(lvl - 1, x, y), build(lvl - 1, x + half, y), build(lvl - 1, x, y + half), build(lvl - 1, x + half, y + half) };
+			if(key[1] == 0 && key[2] == 0 && key[3] == 0 && key[4] == 0) return 0;
+
+			auto found = internal.find(key);
+			if(found != internal.end()) return found->second;
+
+			if(fprintf(file, "%u %u %u %u %u\n", key[0], key[1], key[2], key[3], key[4]) < 0) failed = true;
+			internal[key] = next_idx;
+			return next_idx++;
+		};
+
+		//An empty board still needs a root node
+		if(build(level, 0, 0) == 0 && fprintf(file, "%i 0 0 0 0\n", level) < 0) failed = true;
+
+		if(fflush(file) != 0 || ferror(file)) failed = true;
+		if(fclose(file) != 0) failed = true;
+		return !failed;
+	}
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
@@ -10,6 +10,17 @@
 #include "Util.h"
 #include "Vector.h"
 #include "Buffer.h"
+#include "Metrics.h"
+#include "Trace.h"
+#include "PerfCounters.h"
+#include "Pattern.h"
+#include "Macrocell.h"
+#include "Snapshot.h"
+#include "Checkpoint.h"
+#include "Recording.h"
+#include "FrameExport.h"
+#include "Density.h"
+#include "Heatmap.h"
 
 
 
@@ -17,6 +28,7 @@
 #ifdef __APPLE__
 #include "GLUT/glut.h"
 #include <OpenGL/gl.h>
+#include <OpenGL/OpenGL.h>
 #else
 #include <windows.h>
 #include "GL/glut.h"
@@ -25,9 +37,9 @@
 
 
 //Frame redraw timer variables
-#define CONTINUOUS_DISPLAY true		//Defines whether the frame is continuously updated and displayed
+#define CONTINUOUS_DISPLAY false		//Redraw on every timer tick instead of only when something changed
 #define MAX_DELAY_TIME 200
-#define DELAY_TIME 0
+#define DELAY_TIME 16					//Frame timer period in milliseconds, which caps the frame rate (~60 fps)
 
 //Define whether using a framebuffer or OpenGL objects
 #define USE_FRAMEBUFFER true
@@ -40,6 +52,11 @@ float Center_X, Center_Y, Center_Z;
 int ImageX = 1260;
 int ImageY = 720;
 int ImageZ = 1000;
+int window_id = 0;
+
+//The window follows the board size up to this limit. Larger boards are panned and zoomed.
+#define MAX_WINDOW_WIDTH 1600
+#define MAX_WINDOW_HEIGHT 900
 //int WINDOW_WIDTH = ImageX;
 //int WINDOW_HEIGHT = ImageY;
 //int WINDOW_DEPTH = ImageZ;
@@ -53,29 +70,22 @@ int field_of_view = 90;
 int delay_time = DELAY_TIME;
 int max_delay_time = MAX_DELAY_TIME;
 
-//------------------------------------FPS Counter-----------------------------------
-timer fps_timer;		//Frames Per Second
-int fps_delay = 1;
-int fps_min = 10000;
-int fps_max = 0;
-int fps_ct = 0;
-int fps = 0;
-
-//------------------------------------SPS Counter-----------------------------------
-timer sps_timer;		//Simulation-Steps Per Second
-int sps_delay = 1;
-int sps_min = 10000;
-int sps_max = 0;
-int sps_ct = 0;
-int sps = 0;
-
-//-----------------------------------PSPS Counter-----------------------------------
-timer psps_timer;		//Particle Simulation-Steps Per Second
-int psps_delay = 1;
-int psps_min = 10000;
-int psps_max = 0;
-int psps_ct = 0;
-int psps = 0;
+std::atomic<bool> frame_pending(true);	//Something changed since the last frame. Set by publishGeneration() and input, cleared by display().
+bool toggle_vsync = false;				//Tie buffer swaps to the display refresh
+
+//-------------------------------------Metrics--------------------------------------
+metrics_registry metrics;			//Per-thread counters and latency histograms. Found in Metrics.h
+metrics_snapshot metrics_last;		//Merged counters at the start of the current window
+metrics_snapshot metrics_window;	//Counters for the last completed window
+timer metrics_timer;
+float metrics_interval = 1.0f;		//Window length in seconds for the title bar rates
+
+//------------------------------------Benchmark-------------------------------------
+int bench_generations = 0;			//Runs headless for this many generations and prints a report when > 0
+int sim_generation_limit = 0;		//The simulation stops itself on reaching this generation when > 0
+bool bench_counters = false;		//Sample the hardware counters around every step. Found in PerfCounters.h
+perf_sample bench_sample;			//Counters summed over all simulation threads
+std::mutex bench_mtx;
 
 //----------------------------------Mouse Variables---------------------------------
 int global_mouse_x, global_mouse_y, g_mouse_z;	//Global mouse values
@@ -87,12 +97,24 @@ bool mouse_right_pressed = false;
 
 timer sim_timer;			//Precise timer class. Found in Global.h
 string info_str = "";		//Used to display information on the window's title bar
-string save_name = "";		//File name used when saving the framebuffer to disk
+string save_name = "";		//Y4M/PGM file (or "|command" pipe) that generations are streamed to as video frames
+string trace_name = "";		//Chrome trace file written at exit. Tracing is off when empty.
+string pattern_name = "";		//RLE or macrocell (.mc) pattern loaded at start up and by [l]
+string pattern_save_name = "board.rle";		//RLE or macrocell (.mc) file written by [e]
+string snapshot_name = "board.snap";			//Bit-packed board snapshot written by [s] and restored by [o]
+string restore_name = "";						//Snapshot restored at start up
+string record_name = "";						//Recording of every generation written while the simulation runs
+string replay_name = "";						//Recording played back instead of simulating
+string extract_name = "";						//Pattern or snapshot of the --seek generation written headless from the replay
+long long replay_seek = -1;						//Generation shown when the replay opens
+bool replay_playing = false;					//Advance one recorded generation per frame
+
+trace_recorder tracer;		//Per-thread timeline events. Found in Trace.h
 
 bool toggle_shift = false;
 
 bool toggle_simulation_info = false;
-bool toggle_simulation = false;
+std::atomic<bool> toggle_simulation(false);
 bool toggle_integration = true;
 bool toggle_collision = true;
 
@@ -128,14 +150,91 @@ Vector cameraUp(0, 0, 1);
 Vector grid(1000, -10, 1000);
 float grid_spacing = 10;
 
+//-------------------------------------Viewport-------------------------------------
+
+#define VIEW_MAX_ZOOM 64.0f		//Window pixels per cell
+#define VIEW_ZOOM_STEP 1.25f	//Zoom per scroll wheel notch or [Shift]+[Up]/[Down]
+#define VIEW_PAN_STEP 32		//Window pixels per arrow key press
+
+float view_x = 0.0f, view_y = 0.0f;		//Board position (in cells) at the centre of the window
+float view_zoom = 1.0f;					//Window pixels per cell
+
+//-----------------------------------Board Resize-----------------------------------
+
+#define BOARD_RESIZE_STEP 64	//Cells added or removed along each axis by [ and ]
+
+bool toggle_board_follow = false;				//Resize the board to fill the window
+int board_request_x = 0, board_request_y = 0;	//Size asked for by reshape(), applied at the next frame tick
+
 //--------------------------------------Buffers-------------------------------------
-int pixel_offset = 2;
 
-//Framebuffer used to draw the image
-Buffer<float> framebuffer(ImageX * pixel_offset, ImageY * pixel_offset, 3);
+//Framebuffer used to draw the image. One palette index per cell, turned into colour by the pixel maps at upload.
+//Only written directly when pixel buffer objects aren't available; otherwise the PBO is mapped and filled instead.
+Buffer<uint8_t> framebuffer(ImageX, ImageY, 1);
+
+//The board is drawn as one texel per cell on a window sized quad, scaled on the GPU with GL_NEAREST
+GLuint fb_texture = 0;
+GLint fb_max_texture = 0;				//Boards larger than this are only drawn from the density pyramid
+GLuint fb_pbo[2] = { 0, 0 };			//Filled on alternate frames so the upload of one overlaps writing the other
+int fb_pbo_idx = 0;
+int fb_texture_width = 0, fb_texture_height = 0;
+bool fb_use_pbo = false;
+
+//Windows' opengl32 only exports GL 1.1, so the buffer object entry points are looked up once there's a context
+#ifdef _WIN32
+PFNGLGENBUFFERSPROC glGenBuffers = nullptr;
+PFNGLBINDBUFFERPROC glBindBuffer = nullptr;
+PFNGLBUFFERDATAPROC glBufferData = nullptr;
+PFNGLMAPBUFFERPROC glMapBuffer = nullptr;
+PFNGLUNMAPBUFFERPROC glUnmapBuffer = nullptr;
+#endif
 
-//Cell buffers
-Buffer<bool> cellbuffer = Buffer<bool>(ImageX, ImageY, 2);
+//Board tiles changed since they were last uploaded. Set by edits and at each generation boundary, cleared by fbRender().
+#define TILE_SIZE 64
+std::unique_ptr<std::atomic<uint8_t>[]> tile_dirty;
+std::unique_ptr<std::atomic<uint8_t>[]> tile_changed;	//Tiles changed by the generation being computed, published with it
+int tiles_x = 0, tiles_y = 0;
+std::atomic<bool> fb_invalid(true);		//Upload the whole board on the next frame
+
+//Dirty tiles merged into runs along a tile row, reused every frame
+struct fb_rect { int x, y, w, h; };
+std::vector<fb_rect> fb_rects;
+
+//The rectangles are filled in bands of rows split across a pool of threads (plus the GLUT thread)
+#define FB_FILL_ROWS 16
+struct fb_band { size_t offset; int x, y, w, h; };		//offset is the band's first byte in the packed upload
+std::vector<fb_band> fb_bands;
+worker_pool fill_pool;
+int fill_threads = -1;		//Extra threads filling the framebuffer, -1 picks from the core count
+
+//Live cell density for zoomed out views, kept current one tile at a time by the simulation. Found in Density.h
+enum DENSITY_STATE{ DENSITY_CURRENT=0, DENSITY_STALE=1, DENSITY_PARENTS=2 };
+density_pyramid density;
+std::unique_ptr<std::atomic<uint8_t>[]> tile_density;	//DENSITY_STATE of each tile
+std::atomic<bool> density_invalid(true);				//Rebuild every tile
+std::atomic<bool> density_active(false);				//Only maintained while the view is zoomed out
+GLuint fb_density_texture = 0;
+std::vector<uint8_t> fb_density;						//Part of a level in the window, reused every frame
+
+//Generations since each cell last changed, two planes like cellbuffer. Found in Heatmap.h
+Buffer<uint8_t, huge_page_allocator> agebuffer = Buffer<uint8_t, huge_page_allocator>(1, 1, 2, BUFFER_FORMAT::CV, (uint8_t)HEAT_AGE_MAX);		//Sized by initAges()
+std::atomic<bool> toggle_heatmap(false);		//Colour cells by age instead of alive/dead
+bool age_active = false;						//Ages are maintained. Only changed inside the barrier or while stopped.
+bool fb_palette_heat = false;					//The pixel maps hold the heatmap ramp
+
+//Cell buffers. Planar (CV) so each generation is one contiguous block that can be copied with a single memcpy.
+//Backed by huge pages once it's big enough for TLB misses to matter.
+Buffer<bool, huge_page_allocator> cellbuffer = Buffer<bool, huge_page_allocator>(ImageX, ImageY, 2, BUFFER_FORMAT::CV);
+
+//Periodic snapshots written in the background. Found in Checkpoint.h
+checkpoint_writer checkpoints;
+
+//Every generation as a compressed delta, for replay. Found in Recording.h
+recording_writer recorder;
+recording_reader player;		//Open while in replay mode
+
+//Every Nth generation as raw video frames, written to save_name. Found in FrameExport.h
+frame_exporter exporter;
 
 
 Vector offset(0.0f, 0.0f, -200.0f);
@@ -149,22 +248,32 @@ std::thread sim_thread;
 std::vector<std::thread> sim_threads;
 int num_threads = 1;
 
+thread_barrier sim_barrier;				//Generation boundary shared by the simulation threads
+bool sim_running = false;				//Only changed inside the barrier so every thread leaves on the same generation
+std::atomic<long long> population_step(0);	//Population change accumulated by the threads during the current generation
+
 //--------------------------------------Objects-------------------------------------
 
 float color[3];
 bool swap_buffer_idx = true;
 int survey_generation = 100;	//Survey the population every 100 generations
-int alive_ct = 0;
-int generation_ct = 0;
-int population_ct = 0;
+std::atomic<int> generation_ct(0);
+std::atomic<long long> population_ct(0);
 int dot_size = 1;
 
 int num_colonies = 100;
 
 
+pattern_rule rule;		//Birth/survival neighbour masks, B3/S23 by default. Found in Pattern.h
+
 float alive_color[3] = { 1.0, 1.0, 1.0 };
 float dead_color[3] = { 0.0, 0.0, 0.0 };
 
+//Framebuffer palette indices
+#define PALETTE_DEAD 0
+#define PALETTE_ALIVE 1
+#define PALETTE_SIZE 2		//Pixel map sizes must be a power of two
+
 
 //--------------------------------------Simulation-------------------------------------
 
@@ -184,11 +293,24 @@ float h = 0.1f;//0.00001f;						//Timestep amount
 //=========================================================================================================================
 
 void simulate(int thrd, int thrd_delay);
+void publishGeneration(void);
 void startSim();
 void stopSim();
+void joinSim();
+void runBench(void);
 
 void spawn(int x, int y, int size);
 void survey(void);
+bool loadPattern(const string& file_name);
+bool savePattern(const string& file_name);
+bool saveSnapshot(const string& file_name);
+bool restoreSnapshot(const string& file_name, bool resize);
+bool* cellRow(int j, int z, ptrdiff_t& stride);
+bool startRecording(const string& file_name);
+bool startExport(const string& file_name);
+bool openReplay(const string& file_name);
+bool seekReplay(long long generation);
+void showReplayFrame(void);
 
 void initObj();
 void clearObj();
@@ -198,9 +320,30 @@ void resetStaticObj();
 
 void glRender(void);
 void fbRender(void);
-void fbUpdate(int idx);
+void fbUpdate(int idx, uint8_t* pixels, int x, int y, int w, int h);
+void fbPalette(void);
+void fbInitTexture(int width, int height);
+bool fbLoadBuffers(void);
+void initTiles(void);
+bool initAges(void);
+inline void markTile(std::atomic<uint8_t>* mask, int x, int y);
+void invalidateBoard(void);
+void resizeBoard(int width, int height);
+void updateDensity(void);
+uint8_t* agePlane(int z);
+void setHeatmap(bool on);
+void fbUploadBoard(void);
+void fbUploadDensity(int level, float left, float bottom, float right, float top, float* tex);
+
+void viewFit(int width, int height);
+void viewBounds(float& left, float& bottom, float& right, float& top);
+void viewPan(float dx, float dy);
+void viewZoom(float factor, int x, int y);
+int viewLevel(void);
+void screenToBoard(int sx, int sy, int& x, int& y);
 
 void display(void);
+bool setVsync(bool on);
 void mouseMove(int x, int y);
 void mouseClick(int btn, int state, int x, int y);
 void passiveMouseMove(int x, int y);
@@ -209,6 +352,9 @@ void keyboard(unsigned char key, int x, int y);
 void reshape(int width, int height);
 void glViewMatrices(void);
 void initGL(void);
+void fbResize(int width, int height);
+void parseArgs(int argc, char** argv);
+void exitHandler(void);
 
 
 //=========================================================================================================================
@@ -225,11 +371,8 @@ void initObj() {
 }
 
 void clearObj() {
-	toggle_simulation = false;
-	t_sim = 0;
-
 	//Make sure all simulation threads have terminated
-	std::this_thread::sleep_for (std::chrono::milliseconds(10));
+	stopSim();
 
 	swap_buffer_idx = true;
 
@@ -238,6 +381,8 @@ void clearObj() {
 
 	framebuffer.clear(0);
 	cellbuffer.clear(false);
+	agebuffer.clear(HEAT_AGE_MAX);
+	invalidateBoard();
 }
 
 void resetObj() {
@@ -264,23 +409,301 @@ void resetStaticObj() {
 
 
 void spawn(int x, int y, int size) {
+	metric_timer edit_timer(metrics, EDIT_APPLY);
+	trace_scope edit_trace(tracer, "spawn");
+	metrics.add(EDITS);
+
+	//Switching planes changes the whole board, not just the square
+	if(!swap_buffer_idx) invalidateBoard();
+
 	swap_buffer_idx = true;
 	for (int i = -size; i <= size; i++) {
 		for (int j = -size; j<= size; j++) {
 			cellbuffer( cellbuffer.wrapX(x + i), cellbuffer.wrapY(y + j), swap_buffer_idx) = true;
+			markTile(tile_dirty.get(), cellbuffer.wrapX(x + i), cellbuffer.wrapY(y + j));
+			markTile(tile_density.get(), cellbuffer.wrapX(x + i), cellbuffer.wrapY(y + j));
+			if(age_active) agebuffer(cellbuffer.wrapX(x + i), cellbuffer.wrapY(y + j), swap_buffer_idx) = 0;
 		}
 	}
 }
 
-void survey(void) {
-	population_ct = 0;
+inline bool isMacrocell(const string& file_name) { return file_name.size() > 3 && file_name.compare(file_name.size() - 3, 3, ".mc") == 0; }
+
+//Loads an RLE or macrocell pattern centred on the board. Cells that fall outside the board are dropped.
+bool loadPattern(const string& file_name) {
+	clearObj();
+	trace_scope load_trace(tracer, "loadPattern");
+
+	long long top = 0, left = 0;
+	long long width = cellbuffer.width(), height = cellbuffer.height();
+	pattern_info info;
+
+	//Pattern rows run top to bottom, board rows bottom to top
+	auto place = [&](const pattern_info& p) {
+		left = (width - p.width) / 2;
+		top = (height - p.height) / 2 + p.height - 1;
+	};
+	auto span = [&](long long x, long long y, long long n) {
+		long long j = top - y;
+		if(j < 0 || j >= height) return;
+		long long begin = max(left + x, 0LL), end = min(left + x + n, width);
+		for(long long i = begin; i < end; i++) cellbuffer(i, j, swap_buffer_idx) = true;
+	};
+
+	bool loaded = false;
+	if(isMacrocell(file_name)) {
+		//Only the nodes that overlap the board are visited
+		macrocell mc;
+		loaded = mc.read(file_name.c_str());
+		if(loaded) {
+			info = mc.info;
+			place(info);
+			mc.spans(-left, top - height + 1, width, height, span);
+			printf("Macrocell | %zu unique nodes, population %lld, generation %lld\n", mc.num_nodes(), mc.population(), info.generation);
+		}
+	}
+	else {
+		loaded = readRLE(file_name.c_str(), info, place, span);
+	}
 
+	if(!loaded) {
+		printf("Failed to load pattern | %s\n", file_name.c_str());
+		return false;
+	}
+
+	rule = (info.has_rule)? info.rule : pattern_rule();
+	survey();
+
+	printf("Loaded pattern | %s (%lld x %lld, %s)\n", file_name.c_str(), info.width, info.height, ruleString(rule).c_str());
+	cout.flush();
+	return true;
+}
+
+//Writes the bounding box of the live cells as RLE. The simulation is paused first so the board is a single generation.
+bool savePattern(const string& file_name) {
+	stopSim();
+	trace_scope save_trace(tracer, "savePattern");
+
+	int min_x = cellbuffer.width(), min_y = cellbuffer.height(), max_x = -1, max_y = -1;
 	for (int j = 0; j < cellbuffer.height(); j++) {
 		for (int i = 0; i < cellbuffer.width(); i++) {
-			//Survey the currently active buffer
-			population_ct += cellbuffer(i, j, swap_buffer_idx);
+			if(cellbuffer(i, j, swap_buffer_idx)) {
+				min_x = min(min_x, i); max_x = max(max_x, i);
+				min_y = min(min_y, j); max_y = max(max_y, j);
+			}
+		}
+	}
+	if(max_x < 0) min_x = min_y = max_x = max_y = 0;
+
+	auto cell = [&](long long x, long long y) { return cellbuffer(min_x + x, max_y - y, swap_buffer_idx); };
+	bool saved = (isMacrocell(file_name))? macrocell::write(file_name.c_str(), max_x - min_x + 1, max_y - min_y + 1, rule, generation_ct, cell) 
+										  : writeRLE(file_name.c_str(), max_x - min_x + 1, max_y - min_y + 1, rule, cell);
+
+	printf("%s pattern | %s\n", (saved)? "Saved" : "Failed to save", file_name.c_str());
+	cout.flush();
+	return saved;
+}
+
+//Pointer to the first cell of row j in plane z. Neighbouring cells are stride elements apart.
+bool* cellRow(int j, int z, ptrdiff_t& stride) {
+	stride = cellbuffer.x_stride();
+	return cellbuffer.row_ptr(j, z);
+}
+
+//Starts recording from the current generation. Later generations are captured in publishGeneration().
+bool startRecording(const string& file_name) {
+	if(!recorder.open(file_name.c_str(), cellbuffer.width(), cellbuffer.height(), rule.birth, rule.survive, generation_ct)) {
+		printf("Failed to open recording | %s\n", file_name.c_str());
+		return false;
+	}
+
+	ptrdiff_t stride;
+	recorder.capture(cellRow(0, swap_buffer_idx, stride), cellbuffer.width(), cellbuffer.height(), generation_ct);
+	printf("Recording | %s (keyframe every %i generations)\n", file_name.c_str(), recorder.keyframe_interval);
+	cout.flush();
+	return true;
+}
+
+//Starts streaming frames from the current generation. Later frames are captured in publishGeneration().
+bool startExport(const string& file_name) {
+	if(!exporter.open(file_name, cellbuffer.width(), cellbuffer.height())) {
+		printf("Failed to open frame export | %s\n", file_name.c_str());
+		return false;
+	}
+
+	ptrdiff_t stride;
+	exporter.capture(cellRow(0, swap_buffer_idx, stride), cellbuffer.width(), cellbuffer.height(), generation_ct);
+	printf("Exporting frames | %s (every %i generations, %ix scale)\n", file_name.c_str(), exporter.every, exporter.scale);
+	cout.flush();
+	return true;
+}
+
+//Opens a recording for playback. The board takes the recording's size and rule, and the simulation stays stopped.
+bool openReplay(const string& file_name) {
+	clearObj();
+	if(!player.open(file_name.c_str())) {
+		printf("Failed to open recording | %s\n", file_name.c_str());
+		return false;
+	}
+	if(player.last_generation > INT_MAX) {
+		printf("Failed to open recording | %s (generation %llu is out of range)\n", file_name.c_str(), (unsigned long long)player.last_generation);
+		player.close();
+		return false;
+	}
+
+	//The reader has checked that the size fits in ints
+	if(player.header.width != (uint64_t)cellbuffer.width() || player.header.height != (uint64_t)cellbuffer.height()) {
+		if(!cellbuffer.resize(player.header.width, player.header.height, 2)) {
+			printf("Failed to open recording | %s (not enough memory for a %llu x %llu board)\n", file_name.c_str(), (unsigned long long)player.header.width, (unsigned long long)player.header.height);
+			player.close();
+			return false;
+		}
+		fbResize((int)player.header.width, (int)player.header.height);
+	}
+	rule.birth = player.header.rule_birth;
+	rule.survive = player.header.rule_survive;
+
+	printf("Replay | %s (%llu x %llu, generations %llu - %llu, %zu keyframes, %s)\n", file_name.c_str(), (unsigned long long)player.header.width, 
+			(unsigned long long)player.header.height, (unsigned long long)player.first_generation(), (unsigned long long)player.last_generation, 
+			player.keys.size(), ruleString(rule).c_str());
+	cout.flush();
+
+	return seekReplay((replay_seek >= 0)? replay_seek : (long long)player.first_generation());
+}
+
+//Shows the last recorded generation at or before the given one
+bool seekReplay(long long generation) {
+	if(!player.is_open()) return false;
+	trace_scope seek_trace(tracer, "seekReplay", generation);
+
+	timer seek_timer;
+	seek_timer.start();
+	bool found = player.seek((generation < 0)? 0 : (uint64_t)generation);
+	seek_timer.stop();
+
+	if(!found) {
+		printf("Replay | Failed to decode generation %lli\n", generation);
+		cout.flush();
+		return false;
+	}
+	showReplayFrame();
+
+	if(toggle_simulation_info) {
+		printf("Replay | Generation %llu in %.3f ms\n", (unsigned long long)player.frame.generation, seek_timer.time() * 1000.0);
+		cout.flush();
+	}
+	return true;
+}
+
+//Copies the decoded frame into the active cell buffer
+void showReplayFrame(void) {
+	ptrdiff_t stride;
+	for(int j = 0; j < cellbuffer.height(); j++) {
+		bool* cells = cellRow(j, swap_buffer_idx, stride);
+		unpackRow(player.row(j), cellbuffer.width(), cells, stride);
+	}
+	generation_ct = (int)player.frame.generation;
+	population_ct = (long long)player.frame.population;
+	invalidateBoard();
+}
+
+//Writes the current generation as a bit-packed snapshot. The simulation is paused first.
+bool saveSnapshot(const string& file_name) {
+	stopSim();
+	trace_scope save_trace(tracer, "saveSnapshot");
+
+	snapshot_writer writer;
+	bool saved = writer.open(file_name.c_str(), cellbuffer.width(), cellbuffer.height(), rule.birth, rule.survive, generation_ct);
+	if(saved) {
+		std::vector<uint64_t> words(writer.row_words());
+		ptrdiff_t stride;
+		for(int j = 0; j < cellbuffer.height(); j++) {
+			const bool* cells = cellRow(j, swap_buffer_idx, stride);
+			packRow(cells, stride, cellbuffer.width(), words.data(), words.size());
+			writer.write_row(words.data());
+		}
+		saved = writer.close();
+	}
+
+	printf("%s snapshot | %s\n", (saved)? "Saved" : "Failed to save", file_name.c_str());
+	cout.flush();
+	return saved;
+}
+
+//Restores a snapshot through mmap after checking its hash. With resize the board takes the snapshot's size (only safe
+//before the window exists), otherwise the overlapping region is copied centred.
+bool restoreSnapshot(const string& file_name, bool resize) {
+	snapshot_view view;
+	if(!view.open(file_name.c_str())) {
+		printf("Failed to restore snapshot | %s\n", file_name.c_str());
+		return false;
+	}
+
+	//Catches truncated or corrupted files before the board is touched. Reads the whole file once.
+	if(!view.verify()) {
+		printf("Failed to restore snapshot | %s (contents don't match the checksum)\n", file_name.c_str());
+		return false;
+	}
+
+	bool new_size = view.header.width != (uint64_t)cellbuffer.width() || view.header.height != (uint64_t)cellbuffer.height();
+	if(resize && new_size && (view.header.width == 0 || view.header.height == 0 || view.header.width > INT_MAX || view.header.height > INT_MAX)) {
+		printf("Failed to restore snapshot | %s (%llu x %llu board is too large)\n", file_name.c_str(), (unsigned long long)view.header.width, (unsigned long long)view.header.height);
+		return false;
+	}
+	if(view.header.generation > INT_MAX) {
+		printf("Failed to restore snapshot | %s (generation %llu is out of range)\n", file_name.c_str(), (unsigned long long)view.header.generation);
+		return false;
+	}
+
+	clearObj();
+	trace_scope restore_trace(tracer, "restoreSnapshot");
+
+	if(resize && new_size) {
+		if(!cellbuffer.resize(view.header.width, view.header.height, 2)) {
+			printf("Failed to restore snapshot | %s (not enough memory for a %llu x %llu board)\n", file_name.c_str(), (unsigned long long)view.header.width, (unsigned long long)view.header.height);
+			return false;
 		}
+		fbResize((int)view.header.width, (int)view.header.height);
+	}
+
+	long long src_x = max(0LL, ((long long)view.header.width - cellbuffer.width()) / 2);
+	long long src_y = max(0LL, ((long long)view.header.height - cellbuffer.height()) / 2);
+	long long dst_x = max(0LL, (cellbuffer.width() - (long long)view.header.width) / 2);
+	long long dst_y = max(0LL, (cellbuffer.height() - (long long)view.header.height) / 2);
+	long long w = min((long long)view.header.width, (long long)cellbuffer.width());
+	long long h = min((long long)view.header.height, (long long)cellbuffer.height());
+
+	ptrdiff_t stride;
+	for(long long j = 0; j < h; j++) {
+		bool* cells = cellRow(dst_y + j, swap_buffer_idx, stride) + dst_x * stride;
+		if(src_x == 0) unpackRow(view.row(src_y + j), w, cells, stride);
+		else for(long long i = 0; i < w; i++) cells[i * stride] = view.get(src_x + i, src_y + j);
+	}
+
+	rule.birth = view.header.rule_birth;
+	rule.survive = view.header.rule_survive;
+	generation_ct = (int)view.header.generation;
+	survey();
+
+	printf("Restored snapshot | %s (%llu x %llu, generation %llu, %s)\n", file_name.c_str(), (unsigned long long)view.header.width, 
+			(unsigned long long)view.header.height, (unsigned long long)view.header.generation, ruleString(rule).c_str());
+	cout.flush();
+	return true;
+}
+
+void survey(void) {
+	long long population = 0;
+
+	//Survey the currently active buffer
+	buffer_span<bool> cells = cellbuffer.plane(swap_buffer_idx);
+	if(cells.contiguous()) {
+		const bool* c = cells.data();
+		for (size_t i = 0; i < cells.size(); i++) population += c[i];
 	}
+	else for (bool c : cells) population += c;
+
+	population_ct = population;
+	population_step = 0;
 }
 
 
@@ -288,154 +711,331 @@ void survey(void) {
 //-------------------------------------------------------------------------------------------------------------------------
 //=========================================================================================================================
 void startSim() {
-	sim_threads.clear();
+	//Threads from a previous run must be gone before the barrier is reused
+	stopSim();
+
+	sim_barrier.reset(num_threads);
+	initTiles();
+	sim_running = true;
+	toggle_simulation = true;
+
 	for(int i = 0; i < num_threads; i++) {
 		sim_threads.push_back(std::thread(simulate, i, 0));
-		sim_threads[i].detach();
 	}
-	toggle_simulation = true;
 }
 
 void stopSim() {
-	if(toggle_simulation) {
-		sim_threads.clear();
+	toggle_simulation = false;
+	t_sim = 0;
 
-		toggle_simulation = false;
-		t_sim = 0;
+	joinSim();
+}
+
+//Make sure all simulation threads have terminated. They leave together at the next generation boundary.
+void joinSim() {
+	for(size_t i = 0; i < sim_threads.size(); i++) {
+		if(sim_threads[i].joinable()) sim_threads[i].join();
+	}
+	sim_threads.clear();
+}
+
+//Sizes the dirty tile masks and density pyramid to the board. Only called while the simulation threads are stopped.
+void initTiles(void) {
+	int tx = (cellbuffer.width() + TILE_SIZE - 1) / TILE_SIZE;
+	int ty = (cellbuffer.height() + TILE_SIZE - 1) / TILE_SIZE;
+	if(tile_dirty != nullptr && tx == tiles_x && ty == tiles_y && density.board_width() == cellbuffer.width() && density.board_height() == cellbuffer.height()) return;
+
+	tile_dirty.reset(new std::atomic<uint8_t>[tx * ty]);
+	tile_changed.reset(new std::atomic<uint8_t>[tx * ty]);
+	tile_density.reset(new std::atomic<uint8_t>[tx * ty]);
+	for(int t = 0; t < tx * ty; t++) {
+		tile_dirty[t].store(0, std::memory_order_relaxed);
+		tile_changed[t].store(0, std::memory_order_relaxed);
+		tile_density[t].store(DENSITY_CURRENT, std::memory_order_relaxed);
+	}
+	tiles_x = tx;
+	tiles_y = ty;
+	density.resize(cellbuffer.width(), cellbuffer.height(), TILE_SIZE);
+	invalidateBoard();
+}
+
+//Sizes the age planes to the board. They double the memory a board needs, so they're only allocated once the heatmap
+//is turned on. Called while stopped or inside the generation barrier.
+//Returns false if the age planes don't fit in memory
+bool initAges(void) {
+	if(agebuffer.width() == cellbuffer.width() && agebuffer.height() == cellbuffer.height()) return true;
+	if(!agebuffer.resize(cellbuffer.width(), cellbuffer.height(), 2)) {
+		printf("Heatmap failed | %i x %i ages don't fit in memory\n", cellbuffer.width(), cellbuffer.height());
+		cout.flush();
+		return false;
+	}
+	agebuffer.clear(HEAT_AGE_MAX);
+	return true;
+}
+
+//Start of age plane z (CV format, so rows are contiguous)
+uint8_t* agePlane(int z) {
+	return agebuffer.plane(z).data();
+}
+
+//Switches the heatmap view. Ages are only maintained while it's shown; they start out as old as possible, and the
+//simulation picks the change up at its next generation boundary.
+void setHeatmap(bool on) {
+	toggle_heatmap = on;
+	if(!toggle_simulation && age_active != on) {
+		initTiles();
+		if(on && !initAges()) on = toggle_heatmap = false;
+		age_active = on;
+		if(on) memset(agePlane(swap_buffer_idx), HEAT_AGE_MAX, (size_t)agebuffer.width() * agebuffer.height());
+	}
+	fb_invalid = true;
+}
+
+//The whole board changed: upload all of it and rebuild the density pyramid
+void invalidateBoard(void) {
+	fb_invalid = true;
+	density_invalid = true;
+}
+
+//Changes the board size at runtime. The pattern (both generations and the cell ages) stays centred and in the same
+//place in the window, and a running simulation carries on from the same generation. The buffers keep their memory
+//when they shrink and grow it in steps, so repeated small changes are mostly moves in place.
+void resizeBoard(int width, int height) {
+	width = max(1, width);
+	height = max(1, height);
+	if(width == cellbuffer.width() && height == cellbuffer.height()) return;
+
+	//Recordings, exports and replays are tied to one board size
+	if(recorder.is_open() || exporter.is_open() || player.is_open()) {
+		printf("Board resize ignored | stop recording, exporting or replaying first\n");
+		cout.flush();
+		return;
+	}
+
+	bool running = toggle_simulation;
+	stopSim();
+	trace_scope resize_trace(tracer, "resizeBoard");
+
+	//If memory runs out the board may still have changed along one axis
+	int old_width = cellbuffer.width(), old_height = cellbuffer.height();
+	if(!cellbuffer.resize_centred(width, height, false)) {
+		printf("Board resize failed | %i x %i doesn't fit in memory\n", width, height);
+		cout.flush();
+	}
+	width = cellbuffer.width();
+	height = cellbuffer.height();
+	if(age_active && !agebuffer.resize_centred(width, height, HEAT_AGE_MAX)) {
+		age_active = toggle_heatmap = false;
+		fb_invalid = true;
+	}
+
+	int shift_x = max(0, (width - old_width) / 2) - max(0, (old_width - width) / 2);
+	int shift_y = max(0, (height - old_height) / 2) - max(0, (old_height - height) / 2);
+	view_x += shift_x;
+	view_y += shift_y;
 
-		//Make sure all simulation threads have terminated
-		std::this_thread::sleep_for (std::chrono::milliseconds(10));
+	initTiles();
+	survey();
+	frame_pending = true;
+
+	if(running) startSim();
+}
+
+//Brings the density pyramid up to date on the render thread. Only called while the simulation is stopped.
+void updateDensity(void) {
+	initTiles();
+
+	ptrdiff_t stride;
+	const bool* plane = cellRow(0, swap_buffer_idx, stride);
+	if(density_invalid.exchange(false)) {
+		trace_scope density_trace(tracer, "density_rebuild");
+		density.rebuild(plane);
+		for(int t = 0; t < tiles_x * tiles_y; t++) tile_density[t].store(DENSITY_CURRENT, std::memory_order_relaxed);
+		return;
+	}
+
+	for(int t = 0; t < tiles_x * tiles_y; t++) {
+		uint8_t state = tile_density[t].load(std::memory_order_relaxed);
+		if(state == DENSITY_CURRENT) continue;
+		if(state == DENSITY_STALE) density.update_tile(plane, t % tiles_x, t / tiles_x);
+		density.update_parents(t % tiles_x, t / tiles_x);
+		tile_density[t].store(DENSITY_CURRENT, std::memory_order_relaxed);
+	}
+}
+
+//Flags the tile holding cell (x, y). The load skips the store for tiles that are already flagged.
+inline void markTile(std::atomic<uint8_t>* mask, int x, int y) {
+	if(mask == nullptr) return;
+	std::atomic<uint8_t>& t = mask[(y / TILE_SIZE) * tiles_x + x / TILE_SIZE];
+	if(!t.load(std::memory_order_relaxed)) t.store(1, std::memory_order_relaxed);
+}
+
+//Runs once per generation on the last thread to reach the barrier, while the other threads are parked
+void publishGeneration(void) {
+	swap_buffer_idx = !swap_buffer_idx;
+	generation_ct++;
+	population_ct += population_step.exchange(0);
+	metrics.add(GENERATIONS);
+	frame_pending = true;
+
+	//Start or stop maintaining ages. The next step ages the plane that is visible now.
+	if(toggle_heatmap != age_active) {
+		age_active = toggle_heatmap;
+		if(age_active && !initAges()) age_active = toggle_heatmap = false;
+		if(age_active) memset(agePlane(swap_buffer_idx), HEAT_AGE_MAX, (size_t)agebuffer.width() * agebuffer.height());
+	}
+
+	//Tiles changed by this generation become dirty only now that its plane is the visible one. Density tiles the
+	//workers rebuilt during the step get their parent levels, then the newly changed tiles are queued for the next step.
+	bool density_rebuild = density_active && density_invalid.exchange(false);
+	for(int t = 0; t < tiles_x * tiles_y; t++) {
+		if(tile_density[t].load(std::memory_order_relaxed) == DENSITY_PARENTS) {
+			density.update_parents(t % tiles_x, t / tiles_x);
+			tile_density[t].store(DENSITY_CURRENT, std::memory_order_relaxed);
+		}
+		if(density_rebuild) tile_density[t].store(DENSITY_STALE, std::memory_order_relaxed);
+
+		if(tile_changed[t].load(std::memory_order_relaxed)) {
+			tile_changed[t].store(0, std::memory_order_relaxed);
+			tile_dirty[t].store(1, std::memory_order_relaxed);
+			if(density_active) tile_density[t].store(DENSITY_STALE, std::memory_order_relaxed);
+		}
+	}
+
+	//Copy the new generation for the checkpoint writer while every thread is parked
+	if(checkpoints.due(generation_ct)) {
+		metric_timer checkpoint_timer(metrics, CHECKPOINT_COPY);
+		trace_scope checkpoint_trace(tracer, "checkpoint_capture", generation_ct);
+		ptrdiff_t stride;
+		checkpoints.capture(cellRow(0, swap_buffer_idx, stride), cellbuffer.width(), cellbuffer.height(), rule.birth, rule.survive, generation_ct);
+	}
+
+	if(recorder.is_open()) {
+		metric_timer record_timer(metrics, RECORD_CAPTURE);
+		trace_scope record_trace(tracer, "record_capture", generation_ct);
+		ptrdiff_t stride;
+		recorder.capture(cellRow(0, swap_buffer_idx, stride), cellbuffer.width(), cellbuffer.height(), generation_ct);
 	}
+
+	if(exporter.due(generation_ct)) {
+		metric_timer export_timer(metrics, EXPORT_CAPTURE);
+		trace_scope export_trace(tracer, "export_capture", generation_ct);
+		ptrdiff_t stride;
+		exporter.capture(cellRow(0, swap_buffer_idx, stride), cellbuffer.width(), cellbuffer.height(), generation_ct);
+	}
+
+	//t_sim++;
+	t_sim += t_step;
+
+	if(sim_generation_limit > 0 && generation_ct >= sim_generation_limit) toggle_simulation = false;
+	if(!toggle_simulation) sim_running = false;
+}
+
+//Steps cells [x0, x1) of a row of a width wide board into out. up and down are the (already wrapped) rows above and
+//below, and cells are stride apart. Only the first and last cell of the row wrap around, so the cells between them
+//need no index checks. Adds the population change to delta and returns the number of cells that changed.
+inline int stepRow(const bool* up, const bool* mid, const bool* down, bool* out, ptrdiff_t stride, int width, int x0, int x1, long long& delta) {
+	int changes = 0, born = 0;
+	auto step = [&](ptrdiff_t l, ptrdiff_t c, ptrdiff_t r) {
+		int n = up[l] + up[c] + up[r] + mid[l] + mid[r] + down[l] + down[c] + down[r];
+		bool alive = mid[c];
+		bool next = ((((alive)? rule.survive : rule.birth) >> n) & 1) != 0;
+		out[c] = next;
+		changes += next != alive;
+		born += (int)next - (int)alive;
+	};
+
+	int lo = max(x0, 1), hi = min(x1, width - 1);
+	if(x0 == 0) step((ptrdiff_t)(width - 1) * stride, 0, (ptrdiff_t)(width > 1) * stride);
+	for(int i = lo; i < hi; i++) step((ptrdiff_t)(i - 1) * stride, (ptrdiff_t)i * stride, (ptrdiff_t)(i + 1) * stride);
+	if(x1 == width && width > 1) step((ptrdiff_t)(width - 2) * stride, (ptrdiff_t)(width - 1) * stride, 0);
+
+	delta += born;
+	return changes;
 }
 
 void simulate(int thrd, int thrd_delay) {
 	//Thread Variables
 	int thrd_sps = 0;
-	int thrd_sps_ct = 0;
 	timer thrd_sps_timer;
 	float thrd_t_sim = 0.0f;
-	int thread_check = 0;
+	uint64_t t_begin, t_wait, t_end;
+
+	//Hardware counters only measure the step itself, not the barrier wait
+	perf_counters counters;
+	perf_sample thrd_sample, sample_begin;
+	if(bench_counters) counters.open();
+
+	tracer.name_thread("sim " + to_string(thrd));
 
 	//Start timers
 	sim_timer.start();
 	thrd_sps_timer.start();
 
-	while(toggle_simulation) {
-		sps_ct++;
-		thrd_sps_ct++;
+	while(sim_running) {
+		t_begin = metrics_now();
+		if(counters.is_open()) sample_begin = counters.read();
 
 		//---------------------------------------------------
 		//---------------------------------------------------
-		
-		if(thrd == 0) {
-			//cellbuffer.clearZ(!swap_buffer_idx);
-			generation_ct++;
-		}
-
-		for (int j = thrd; j < cellbuffer.height(); j+=num_threads) {
-			for (int i = 0; i < cellbuffer.width(); i++)
-			{
-				cellbuffer(i, j, !swap_buffer_idx) = false;
-
-				alive_ct = 0;
-
-				alive_ct += cellbuffer(cellbuffer.wrapX(i - 1), cellbuffer.wrapY(j - 1), swap_buffer_idx);
-				alive_ct += cellbuffer(cellbuffer.wrapX(  i  ), cellbuffer.wrapY(j - 1), swap_buffer_idx);
-				alive_ct += cellbuffer(cellbuffer.wrapX(i + 1), cellbuffer.wrapY(j - 1), swap_buffer_idx);
-				alive_ct += cellbuffer(cellbuffer.wrapX(i - 1), cellbuffer.wrapY(  j  ), swap_buffer_idx);
-				alive_ct += cellbuffer(cellbuffer.wrapX(i + 1), cellbuffer.wrapY(  j  ), swap_buffer_idx); 
-				alive_ct += cellbuffer(cellbuffer.wrapX(i - 1), cellbuffer.wrapY(j + 1), swap_buffer_idx);
-				alive_ct += cellbuffer(cellbuffer.wrapX(  i  ), cellbuffer.wrapY(j + 1), swap_buffer_idx);
-				alive_ct += cellbuffer(cellbuffer.wrapX(i + 1), cellbuffer.wrapY(j + 1), swap_buffer_idx);
-
-				//Apply conditions to current cell
-				if (cellbuffer(i, j, swap_buffer_idx))
-				{
-					if (alive_ct < 2)
-					{
-						cellbuffer(i, j, !swap_buffer_idx) = false;
-						population_ct--;
-					}
-					else if (alive_ct == 2 || alive_ct == 3)
-					{
-						cellbuffer(i, j, !swap_buffer_idx) = true;
-					}
-					else if (alive_ct > 3)
-					{
-						cellbuffer(i, j, !swap_buffer_idx) = false;
-						population_ct--;
-					}
-					else
-					{
-						cellbuffer(i, j, !swap_buffer_idx) = true;
-					}
-				}
-				else if (alive_ct == 3)
-				{
-					cellbuffer(i, j, !swap_buffer_idx) = true;
-					population_ct++;
-				}
+
+		//Rebuild this thread's share of the density tiles the last generation changed. Their plane is the visible
+		//one, which nothing writes during the step.
+		{
+			ptrdiff_t stride;
+			const bool* plane = cellRow(0, swap_buffer_idx, stride);
+			for(int t = thrd; t < tiles_x * tiles_y; t += num_threads) {
+				if(tile_density[t].load(std::memory_order_relaxed) != DENSITY_STALE) continue;
+				density.update_tile(plane, t % tiles_x, t / tiles_x);
+				tile_density[t].store(DENSITY_PARENTS, std::memory_order_relaxed);
 			}
 		}
 
-		
-		//---------------------------------------------------
-		//Integrate States
-		//---------------------------------------------------
-
-		//-------------------------	
-		//-------------------------
+		long long population_delta = 0;
+		int rows = 0;
 
-		//---------------------------------------------------
-		//---------------------------------------------------		
-		//---------------------------------------------------
-		//---------------------------------------------------
-		//---------------------------------------------------
-		
-		//t_sim++;
-		t_sim += t_step;
-		thrd_t_sim += t_step;
-	
-		//---------------------------------------------------
-		//---------------------------------------------------
-		//---------------------------------------------------
-		//---------------------------------------------------
-		//---------------------------------------------------
+		int width = cellbuffer.width(), height = cellbuffer.height();
+		ptrdiff_t stride = cellbuffer.x_stride();
 
-		if(thrd == 0) {
-			//Check if time to render
-			if(sim_timer.current(1000) >= target_frame_time) {
-				swap_buffer_idx = !swap_buffer_idx;
-				
-				
-				if(toggle_simulation_info) {
-					sim_timer.stop();
-					printf("\rFrame Time: %f ms\n", sim_timer.time(1000));
-				}
+		for (int j = thrd; j < height; j+=num_threads) {
+			rows++;
+			const bool* up = cellbuffer.row_ptr(cellbuffer.wrapY(j - 1), swap_buffer_idx);
+			const bool* mid = cellbuffer.row_ptr(j, swap_buffer_idx);
+			const bool* down = cellbuffer.row_ptr(cellbuffer.wrapY(j + 1), swap_buffer_idx);
+			bool* out = cellbuffer.row_ptr(j, !swap_buffer_idx);
 
-				//Restart the simulation timer
-				sim_timer.start();
+			//One tile at a time, so each changed tile is marked once per row
+			for(int x = 0; x < width; x += TILE_SIZE) {
+				if(stepRow(up, mid, down, out, stride, width, x, min(x + TILE_SIZE, width), population_delta) > 0) markTile(tile_changed.get(), x, j);
 			}
 
-			//------------------------
-			
-			//Update simulations per second
-			if (sps_ct % sps_delay == 0) {
-				sps_timer.stop();
-				sps = (1000 / (sps_timer.timef(1000))) * sps_delay;
-				sps_min = (sps < sps_min) ? sps : sps_min;
-				sps_timer.start();
-			}
+			//Age the row in a vectorised pass while it's still in cache
+			if(age_active) ageRow(mid, out, agebuffer.row_ptr(j, swap_buffer_idx), agebuffer.row_ptr(j, !swap_buffer_idx), width);
 		}
 
+		population_step += population_delta;
+		thrd_t_sim += t_step;
+
+		if(counters.is_open()) thrd_sample += counters.read() - sample_begin;
+		t_wait = metrics_now();
+		metrics.add(CELL_UPDATES, (uint64_t)rows * width);
+		metrics.record(STEP_TIME, t_wait - t_begin);
+		tracer.complete("step", t_begin, t_wait, generation_ct);
+
+		//---------------------------------------------------
+		//Generation Boundary
+		//---------------------------------------------------
+
+		//Wait for every thread to finish the generation. The last one to arrive swaps the buffers.
+		sim_barrier.wait(publishGeneration);
+		t_end = metrics_now();
+		metrics.record(BARRIER_WAIT, t_end - t_wait);
+		tracer.complete("barrier_wait", t_wait, t_end);
+
 		//---------------------------------------------------
 
 		//Update thread steps per second
-		if (thrd_sps_ct % sps_delay == 0) {
-			thrd_sps_timer.stop();
-			thrd_sps = (1000 / (thrd_sps_timer.timef(1000))) * sps_delay;
-			thrd_sps_timer.start();
-		}
+		thrd_sps = 1.0f / thrd_sps_timer.lapf();
 
 		//---------------------------------------------------
 
@@ -453,7 +1053,10 @@ void simulate(int thrd, int thrd_delay) {
 		//---------------------------------------------------
 
 		//Apply simulation thread delay
-		std::this_thread::sleep_for (std::chrono::microseconds(thrd_delay));
+		if(thrd_delay != 0) {
+			trace_scope sleep_trace(tracer, "throttle_sleep", thrd_delay);
+			std::this_thread::sleep_for (std::chrono::microseconds(thrd_delay));
+		}
 		//std::this_thread::sleep_for (std::chrono::microseconds(sim_delay));
 
 		//---------------------------------------------------
@@ -462,6 +1065,55 @@ void simulate(int thrd, int thrd_delay) {
 		//---------------------------------------------------
 
 	} //END_OF_LOOP
+
+	if(counters.is_open()) {
+		std::lock_guard<std::mutex> lock(bench_mtx);
+		bench_sample += thrd_sample;
+	}
+}
+
+//=========================================================================================================================
+//--------------------------------------------------------Benchmark--------------------------------------------------------
+//=========================================================================================================================
+
+//Runs the simulation headless for bench_generations and prints throughput, step latency and hardware counters
+void runBench(void) {
+	metrics.reset();
+	bench_sample.clear();
+	bench_counters = true;
+	sim_generation_limit = generation_ct + bench_generations;
+
+	timer bench_timer;
+	bench_timer.start();
+	startSim();
+	joinSim();
+	bench_timer.stop();
+
+	bench_counters = false;
+	sim_generation_limit = 0;
+
+	metrics_snapshot s = metrics.snapshot();
+	double seconds = bench_timer.time();
+	double cells = (double)s.counters[CELL_UPDATES];
+	double gens = (double)s.counters[GENERATIONS];
+
+	printf("engine        threads  board        generations  seconds    gen/s       Mcells/s    step p50 ms  step p99 ms  barrier p99 ms\n");
+	printf("%-13s %-8i %5ix%-6i %-12.0f %-10.4f %-11.2f %-11.2f %-12.4f %-12.4f %-12.4f\n", "buffer<bool>", num_threads, cellbuffer.width(), cellbuffer.height(),
+			gens, seconds, gens / seconds, cells / seconds * 1e-6, s.percentile(STEP_TIME, 0.5), s.percentile(STEP_TIME, 0.99), s.percentile(BARRIER_WAIT, 0.99));
+
+	//Hardware counters per cell update and per generation
+	if(bench_sample.valid[PERF_CYCLES]) {
+		printf("\ncounter          total              per generation     per cell\n");
+		for(int e = 0; e < PERF_NUM_EVENTS; e++) {
+			if(!bench_sample.valid[e]) printf("%-16s n/a\n", perf_event_names[e]);
+			else printf("%-16s %-18llu %-18.1f %-10.4f\n", perf_event_names[e], (unsigned long long)bench_sample.value[e], bench_sample.value[e] / gens, bench_sample.value[e] / cells);
+		}
+		printf("IPC              %.3f\n", bench_sample.ipc());
+	}
+	else {
+		printf("\nHardware counters unavailable (perf_event_open failed or not Linux)\n");
+	}
+	cout.flush();
 }
 
 //=========================================================================================================================
@@ -469,25 +1121,48 @@ void simulate(int thrd, int thrd_delay) {
 //=========================================================================================================================
 
 void display(void) {
+	trace_scope display_trace(tracer, "display", generation_ct);
+	frame_pending = false;
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glCullFace(GL_BACK);
-	fps_ct++;
+	metrics.add(FRAMES);
 
 	//---------------------------------------------------
 
+	//Close the metrics window once per interval
+	if(metrics_timer.current() >= metrics_interval) {
+		metrics_snapshot snapshot = metrics.snapshot();
+		metrics_window = snapshot - metrics_last;
+		metrics_last = snapshot;
+		metrics_timer.start();
+
+		if(toggle_simulation_info) {
+			printf("%s", metrics_window.info().c_str());
+			cout.flush();
+		}
+	}
+
+	//Advance the replay one recorded generation per frame
+	if(player.is_open() && replay_playing) {
+		if(player.next()) showReplayFrame();
+		else replay_playing = false;
+	}
+
 	//Display information on window's title bar
 	info_str = "";
 	//info_str += "\t\tTarget Sim Rate: " + to_string(sim_delay) + " us ";
 
 	//info_str += "h: " + to_string(h);
 
-	info_str += "FPS: " + to_string(fps);
-	info_str += "\t SPS: " + to_string(sps);
+	info_str += "FPS: " + to_string((int)metrics_window.rate(FRAMES));
+	info_str += "\t SPS: " + to_string((int)metrics_window.rate(GENERATIONS));
+	info_str += "\t Step p99: " + to_string(metrics_window.percentile(STEP_TIME, 0.99)) + " ms";
 
-	info_str += "\t\tGen: " + to_string(generation_ct);
-	info_str += "\t\tPop: " + to_string(population_ct);
+	info_str += "\t\tGen: " + to_string(generation_ct.load());
+	info_str += "\t\tPop: " + to_string(population_ct.load());
 	info_str += "\t\tDraw Size: " + to_string(dot_size);
-	//info_str += "\t\t\tPSPS: " + to_string(psps);
+	if(player.is_open()) info_str += "\t\tReplay: " + to_string(player.last_generation) + ((replay_playing)? " (Playing)" : " (Paused)");
+	//info_str += "\t\t\tCells/s: " + to_string(metrics_window.rate(CELL_UPDATES));
 
 		
 	//---------------------------------------------------
@@ -519,21 +1194,12 @@ void display(void) {
 	else
 		glRender();		//Use OpenGL framebuffer
 	
-	glFinish();
-	//Swap framebuffers
-	glutSwapBuffers();
-	//glFlush();
-
-	//---------------------------------------------------
-	//---------------------------------------------------
-
-	//Update frames per second
-	if (fps_ct % fps_delay == 0) {
-		fps_timer.stop();
-		fps = (1000 / (fps_timer.timef(1000))) * fps_delay;
-		fps_min = (fps < fps_min) ? fps : fps_min;
-		fps_timer.start();
+	{
+		//Swap framebuffers. The swap already waits for the frame (and for the refresh with vsync), so no glFinish.
+		trace_scope swap_trace(tracer, "swap");
+		glutSwapBuffers();
 	}
+	//glFlush();
 
 	//---------------------------------------------------
 }
@@ -650,53 +1316,344 @@ void glRender() {
 
 // Draws the scene
 void fbRender(void) {
-	
-	fbUpdate(swap_buffer_idx);
-	
-	//Draws the pixel values from the framebuffer
-	glDrawPixels(framebuffer.width(), framebuffer.height(), GL_RGB, GL_FLOAT, framebuffer.data());
+	metric_timer upload_timer(metrics, RENDER_UPLOAD);
+	if(fb_max_texture == 0) glGetIntegerv(GL_MAX_TEXTURE_SIZE, &fb_max_texture);
+
+	//Tile masks and the pyramid follow the board size (the simulation sizes them itself when it starts)
+	if(!toggle_simulation) initTiles();
+
+	//Part of the board in the window, in cells
+	float left, bottom, right, top;
+	viewBounds(left, bottom, right, top);
+
+	//The simulation only keeps the density pyramid current while it's being drawn
+	int level = viewLevel();
+	if(level > 0 && !density_active) density_invalid = true;
+	density_active = level > 0;
+
+	//Texture coordinates of the window corners (s0, t0, s1, t1)
+	float tex[4];
+	if(level == 0) {
+		if(fb_palette_heat != age_active) {
+			fbPalette();
+			fb_invalid = true;
+		}
+		fbUploadBoard();
+		glBindTexture(GL_TEXTURE_2D, fb_texture);
+
+		//The board texture repeats, so the view wraps around the edges like the board does
+		tex[0] = left / fb_texture_width;
+		tex[1] = bottom / fb_texture_height;
+		tex[2] = right / fb_texture_width;
+		tex[3] = top / fb_texture_height;
+	}
+	else {
+		if(!toggle_simulation) updateDensity();
+		fbUploadDensity(level, left, bottom, right, top, tex);
+	}
+
+	//One quad over the whole viewport
+	trace_scope draw_trace(tracer, "drawQuad", level);
+	glPushAttrib(GL_ENABLE_BIT);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_TEXTURE_2D);
+
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glColor3f(1.0f, 1.0f, 1.0f);
+	glBegin(GL_QUADS);
+		glTexCoord2f(tex[0], tex[1]); glVertex2f(-1.0f, -1.0f);
+		glTexCoord2f(tex[2], tex[1]); glVertex2f( 1.0f, -1.0f);
+		glTexCoord2f(tex[2], tex[3]); glVertex2f( 1.0f,  1.0f);
+		glTexCoord2f(tex[0], tex[3]); glVertex2f(-1.0f,  1.0f);
+	glEnd();
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
+
+	glBindTexture(GL_TEXTURE_2D, 0);
 	glFlush();
 }
 
+//Brings the board texture up to date, uploading only the tiles that changed since the last call
+void fbUploadBoard(void) {
+	//Texture and PBOs follow the board size
+	if(fb_texture == 0 || fb_texture_width != cellbuffer.width() || fb_texture_height != cellbuffer.height()) fbInitTexture(cellbuffer.width(), cellbuffer.height());
+	glBindTexture(GL_TEXTURE_2D, fb_texture);
+
+	//Collect the dirty tiles as rectangles, merging neighbours along each tile row. Ages change everywhere, so the
+	//heatmap is always uploaded whole.
+	fb_rects.clear();
+	bool full = fb_invalid.exchange(false) || fb_palette_heat || tile_dirty == nullptr || tiles_x * TILE_SIZE < fb_texture_width || tiles_y * TILE_SIZE < fb_texture_height;
+	for(int ty = 0; ty < tiles_y && tile_dirty != nullptr; ty++) {
+		for(int tx = 0; tx < tiles_x; tx++) {
+			if(!tile_dirty[ty * tiles_x + tx].exchange(0, std::memory_order_relaxed) || full) continue;
+
+			int x = tx * TILE_SIZE, y = ty * TILE_SIZE;
+			fb_rect r = { x, y, min(TILE_SIZE, fb_texture_width - x), min(TILE_SIZE, fb_texture_height - y) };
+			if(fb_rects.size() > 0 && fb_rects.back().y == y && fb_rects.back().x + fb_rects.back().w == x) fb_rects.back().w += r.w;
+			else fb_rects.push_back(r);
+		}
+	}
+	if(full) fb_rects.assign(1, { 0, 0, fb_texture_width, fb_texture_height });
+
+	if(fb_rects.size() > 0) {
+		{
+			trace_scope update_trace(tracer, "fbUpdate", fb_rects.size());
+			uint8_t* pixels = framebuffer.data();
+			if(fb_use_pbo) {
+				//Orphan the buffer so the driver never waits on an upload still reading it, then fill the dirty parts in place
+				fb_pbo_idx = !fb_pbo_idx;
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, fb_pbo[fb_pbo_idx]);
+				glBufferData(GL_PIXEL_UNPACK_BUFFER, (size_t)fb_texture_width * fb_texture_height, nullptr, GL_STREAM_DRAW);
+				pixels = (uint8_t*)glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+			}
+			//Rectangles are packed one after another, so no GL_UNPACK_ROW_LENGTH is needed (the total never exceeds the board)
+			fb_bands.clear();
+			size_t offset = 0;
+			for(size_t r = 0; r < fb_rects.size(); r++) {
+				const fb_rect& rect = fb_rects[r];
+				for(int j = 0; j < rect.h; j += FB_FILL_ROWS) fb_bands.push_back({ offset + (size_t)j * rect.w, rect.x, rect.y + j, rect.w, min(FB_FILL_ROWS, rect.h - j) });
+				offset += (size_t)rect.w * rect.h;
+			}
+
+			int idx = swap_buffer_idx;
+			if(pixels != nullptr) fill_pool.run((int)fb_bands.size(), [&](int b) {
+				const fb_band& band = fb_bands[b];
+				fbUpdate(idx, pixels + band.offset, band.x, band.y, band.w, band.h);
+			});
+			if(fb_use_pbo && pixels != nullptr) glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+
+		{
+			//Palette indices are turned into colour by the pixel maps as the texture is written
+			trace_scope upload_trace(tracer, "glTexSubImage2D", fb_rects.size());
+			const uint8_t* base = (fb_use_pbo)? nullptr : framebuffer.data();
+			size_t offset = 0;
+			for(size_t r = 0; r < fb_rects.size(); r++) {
+				const fb_rect& rect = fb_rects[r];
+				glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, GL_COLOR_INDEX, GL_UNSIGNED_BYTE, base + offset);
+				offset += (size_t)rect.w * rect.h;
+			}
+			if(fb_use_pbo) glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+	}
+}
+
+//Copies the part of pyramid level k in the window into the density texture, wrapping around the edges, and sets
+//its texture coordinates. About one entry per window pixel is touched, however large the board is.
+void fbUploadDensity(int level, float left, float bottom, float right, float top, float* tex) {
+	trace_scope density_trace(tracer, "fbUploadDensity", level);
+	float scale = (float)(1 << level);
+	int level_width = density.level_width(level), level_height = density.level_height(level);
+	int x0 = (int)floorf(left / scale), y0 = (int)floorf(bottom / scale);
+	int w = max(1, (int)ceilf(right / scale) - x0), h = max(1, (int)ceilf(top / scale) - y0);
+
+	fb_density.resize((size_t)w * h);
+	for(int j = 0; j < h; j++) {
+		const uint8_t* src = density.level(level) + (size_t)(((y0 + j) % level_height + level_height) % level_height) * level_width;
+		uint8_t* dst = fb_density.data() + (size_t)j * w;
+		for(int i = 0, x = (x0 % level_width + level_width) % level_width; i < w; x = 0) {
+			int n = min(w - i, level_width - x);
+			memcpy(dst + i, src + x, n);
+			i += n;
+		}
+	}
+
+	if(fb_density_texture == 0) {
+		glGenTextures(1, &fb_density_texture);
+		glBindTexture(GL_TEXTURE_2D, fb_density_texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	glBindTexture(GL_TEXTURE_2D, fb_density_texture);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+
+	//The pixel transfer scale and bias blend from the dead to the alive colour by density as the texture is written
+	glPushAttrib(GL_PIXEL_MODE_BIT);
+	glPixelTransferf(GL_RED_SCALE, alive_color[0] - dead_color[0]);		glPixelTransferf(GL_RED_BIAS, dead_color[0]);
+	glPixelTransferf(GL_GREEN_SCALE, alive_color[1] - dead_color[1]);	glPixelTransferf(GL_GREEN_BIAS, dead_color[1]);
+	glPixelTransferf(GL_BLUE_SCALE, alive_color[2] - dead_color[2]);	glPixelTransferf(GL_BLUE_BIAS, dead_color[2]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, w, h, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, fb_density.data());
+	glPopAttrib();
+
+	tex[0] = (left / scale - x0) / w;
+	tex[1] = (bottom / scale - y0) / h;
+	tex[2] = (right / scale - x0) / w;
+	tex[3] = (top / scale - y0) / h;
+}
+
 //=========================================================================================================================
 //-------------------------------------------------------------------------------------------------------------------------
 //=========================================================================================================================
 
-void fbUpdate(int idx) {
-	int x, y;
-    for (int j = 0; j < cellbuffer.height(); j++){
-		for (int i = 0; i < cellbuffer.width(); i++) {
-			x = i * pixel_offset;
-			y = j * pixel_offset;
-
-			if(cellbuffer(i, j, idx)) {
-				for(int r = 0; r < pixel_offset; r++)
-				for(int c = 0; c < pixel_offset; c++) {
-					framebuffer(x+r, y+c, 0) = alive_color[0];
-					framebuffer(x+r, y+c, 1) = alive_color[1];
-					framebuffer(x+r, y+c, 2) = alive_color[2];
-				}
-			}
-			else {
-				for(int r = 0; r < pixel_offset; r++)
-				for(int c = 0; c < pixel_offset; c++) {
-					framebuffer(x+r, y+c, 0) = dead_color[0];
-					framebuffer(x+r, y+c, 1) = dead_color[1];
-					framebuffer(x+r, y+c, 2) = dead_color[2];
-				}
-			}	
-		}
+//Writes one palette index per cell of the w x h rectangle at (x, y) into pixels, as w x h bytes with the bottom row first.
+//Cells are already their palette index (PALETTE_DEAD 0, PALETTE_ALIVE 1), so contiguous rows are copied whole.
+void fbUpdate(int idx, uint8_t* pixels, int x, int y, int w, int h) {
+	BufferView<bool> rect = cellbuffer.region(x, y, w, h).channel(idx);
+	BufferView<uint8_t> ages_rect = (fb_palette_heat)? agebuffer.region(x, y, w, h).channel(idx) : BufferView<uint8_t>();
+    for (int j = 0; j < h; j++){
+		buffer_span<bool> cells = rect.row(j, 0);
+		uint8_t* row = pixels + (size_t)j * w;
+		if(fb_palette_heat) {
+			const uint8_t* ages = ages_rect.row_ptr(j, 0);
+			if(cells.contiguous()) heatRow(cells.data(), ages, row, w);
+			else for (int i = 0; i < w; i++) row[i] = heatIndex(cells[i], ages[i]);
+		}
+		else if(cells.contiguous()) memcpy(row, cells.data(), w);
+		else for (int i = 0; i < w; i++) row[i] = (cells[i])? PALETTE_ALIVE : PALETTE_DEAD;
+	}
+}
+
+//Finds the buffer object entry points where they aren't linked directly. Returns false if any is missing.
+bool fbLoadBuffers(void) {
+	#ifdef _WIN32
+		//Core names first, then the ARB extension's for older drivers
+		auto load = [](const char* name, const char* arb) { PROC p = wglGetProcAddress(name); return (p != nullptr)? p : wglGetProcAddress(arb); };
+		glGenBuffers = (PFNGLGENBUFFERSPROC)load("glGenBuffers", "glGenBuffersARB");
+		glBindBuffer = (PFNGLBINDBUFFERPROC)load("glBindBuffer", "glBindBufferARB");
+		glBufferData = (PFNGLBUFFERDATAPROC)load("glBufferData", "glBufferDataARB");
+		glMapBuffer = (PFNGLMAPBUFFERPROC)load("glMapBuffer", "glMapBufferARB");
+		glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)load("glUnmapBuffer", "glUnmapBufferARB");
+		return glGenBuffers != nullptr && glBindBuffer != nullptr && glBufferData != nullptr && glMapBuffer != nullptr && glUnmapBuffer != nullptr;
+	#else
+		return true;
+	#endif
+}
+
+//(Re)creates the board texture and its pixel buffer objects. PBOs are used when the GL has them (2.1 core or
+//ARB_pixel_buffer_object) and their entry points load, otherwise the texture is updated from framebuffer.
+void fbInitTexture(int width, int height) {
+	if(fb_texture == 0) {
+		const char* version = (const char*)glGetString(GL_VERSION);
+		const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+		fb_use_pbo = (version != nullptr && atof(version) >= 2.1) || (extensions != nullptr && strstr(extensions, "GL_ARB_pixel_buffer_object") != nullptr);
+		fb_use_pbo = fb_use_pbo && fbLoadBuffers();
+		glGenTextures(1, &fb_texture);
+		if(fb_use_pbo) glGenBuffers(2, fb_pbo);
 	}
+
+	glBindTexture(GL_TEXTURE_2D, fb_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	if(framebuffer.width() != width || framebuffer.height() != height) framebuffer.resize(width, height, 1);
+	fb_texture_width = width;
+	fb_texture_height = height;
+	fb_invalid = true;
+}
+
+//Loads the alive/dead colours into the colour index pixel maps applied when the texture is written
+//(the heatmap ramp while ages are maintained)
+void fbPalette(void) {
+	float map_r[HEAT_PALETTE_SIZE], map_g[HEAT_PALETTE_SIZE], map_b[HEAT_PALETTE_SIZE], map_a[HEAT_PALETTE_SIZE];
+	const float* colors[PALETTE_SIZE] = { dead_color, alive_color };
+	int size = (age_active)? HEAT_PALETTE_SIZE : PALETTE_SIZE;
+
+	for(int i = 0; i < size; i++) {
+		float rgb[3] = { colors[i & 1][0], colors[i & 1][1], colors[i & 1][2] };
+		if(age_active) heatColor(i, dead_color, rgb);
+		map_r[i] = rgb[0];
+		map_g[i] = rgb[1];
+		map_b[i] = rgb[2];
+		map_a[i] = 1.0f;
+	}
+
+	glPixelMapfv(GL_PIXEL_MAP_I_TO_R, size, map_r);
+	glPixelMapfv(GL_PIXEL_MAP_I_TO_G, size, map_g);
+	glPixelMapfv(GL_PIXEL_MAP_I_TO_B, size, map_b);
+	glPixelMapfv(GL_PIXEL_MAP_I_TO_A, size, map_a);
+	fb_palette_heat = age_active;
 }
 
 //=========================================================================================================================
 //-------------------------------------------------------------------------------------------------------------------------
 //=========================================================================================================================
 
+//The framebuffer itself is sized with the board texture, so boards too big for a texture never allocate one
 void fbResize(int width, int height) {
-	framebuffer.resize(width * 2, height * 2, 3);
-	ImageX = width;
-	ImageY = height;
+	//Before the window exists it takes the board size, up to a limit. After that its size is left to the user.
+	if(window_id == 0) {
+		ImageX = min(width, MAX_WINDOW_WIDTH);
+		ImageY = min(height, MAX_WINDOW_HEIGHT);
+	}
+	viewFit(width, height);
+}
+
+//=========================================================================================================================
+//--------------------------------------------------------Viewport---------------------------------------------------------
+//=========================================================================================================================
+
+//Centres the board and zooms to fit it in the window (whole pixels per cell when it's smaller than the window)
+void viewFit(int width, int height) {
+	view_x = width / 2.0f;
+	view_y = height / 2.0f;
+	view_zoom = min((float)ImageX / width, (float)ImageY / height);
+	if(view_zoom >= 1.0f) view_zoom = min(floorf(view_zoom), VIEW_MAX_ZOOM);
+}
+
+//Part of the board in the window, in cells. Not wrapped, so the edges can fall outside the board.
+void viewBounds(float& left, float& bottom, float& right, float& top) {
+	left = view_x - ImageX / (2.0f * view_zoom);
+	right = view_x + ImageX / (2.0f * view_zoom);
+	bottom = view_y - ImageY / (2.0f * view_zoom);
+	top = view_y + ImageY / (2.0f * view_zoom);
+}
+
+//Moves the centre of the view by (dx, dy) window pixels, wrapping around the board
+void viewPan(float dx, float dy) {
+	view_x = fmodf(view_x + dx / view_zoom, (float)cellbuffer.width());
+	view_y = fmodf(view_y + dy / view_zoom, (float)cellbuffer.height());
+	if(view_x < 0) view_x += cellbuffer.width();
+	if(view_y < 0) view_y += cellbuffer.height();
+}
+
+//Zooms by factor, keeping the board position under window pixel (x, y) in place. The view can shrink to half the
+//size that fits the whole board.
+void viewZoom(float factor, int x, int y) {
+	float min_zoom = min((float)ImageX / cellbuffer.width(), (float)ImageY / cellbuffer.height()) / 2.0f;
+	float zoom = min(max(view_zoom * factor, min_zoom), VIEW_MAX_ZOOM);
+	float dx = x - ImageX / 2.0f, dy = y - ImageY / 2.0f;
+
+	viewPan(dx, dy);
+	view_zoom = zoom;
+	viewPan(-dx, -dy);
+}
+
+//Pyramid level drawn at the current zoom. Level 0 (the board texture) while a cell covers at least a pixel, then one
+//level per halving so a density entry stays about a pixel across.
+int viewLevel(void) {
+	int level = 0;
+	while(level + 1 < density.num_levels() && view_zoom * (2 << level) <= 1.0f) level++;
+
+	//Boards too large for a texture are only drawn from the pyramid
+	bool fits = fb_max_texture == 0 || (cellbuffer.width() <= fb_max_texture && cellbuffer.height() <= fb_max_texture);
+	return (level == 0 && !fits && density.num_levels() > 1)? 1 : level;
+}
+
+//Board cell under window pixel (sx, sy), with y already flipped to point up
+void screenToBoard(int sx, int sy, int& x, int& y) {
+	int width = cellbuffer.width(), height = cellbuffer.height();
+	x = (int)floorf(view_x + (sx + 0.5f - ImageX / 2.0f) / view_zoom) % width;
+	y = (int)floorf(view_y + (sy + 0.5f - ImageY / 2.0f) / view_zoom) % height;
+	x += (x < 0)? width : 0;
+	y += (y < 0)? height : 0;
 }
 
 
@@ -936,6 +1893,24 @@ void keyboard(unsigned char key, int x, int y) {
 			break;
 		}
 
+		//--------------------------------------------
+
+		case '[': {		//Shrink the board
+			resizeBoard(cellbuffer.width() - BOARD_RESIZE_STEP, cellbuffer.height() - BOARD_RESIZE_STEP);
+			printf("Board Size | %i x %i\n", cellbuffer.width(), cellbuffer.height());
+			cout.flush();
+			break;
+		}
+
+		//--------------------------------------------
+
+		case ']': {		//Grow the board
+			resizeBoard(cellbuffer.width() + BOARD_RESIZE_STEP, cellbuffer.height() + BOARD_RESIZE_STEP);
+			printf("Board Size | %i x %i\n", cellbuffer.width(), cellbuffer.height());
+			cout.flush();
+			break;
+		}
+
 		//----------------------------------------------------------------------------------------------------------
 		//-------------------------------------------------Letters--------------------------------------------------
 		//----------------------------------------------------------------------------------------------------------
@@ -982,15 +1957,15 @@ void keyboard(unsigned char key, int x, int y) {
 
 		//--------------------------------------------
 
-		case 'e': {		//
-			
+		case 'e': {		//Export the board as RLE
+			savePattern(pattern_save_name);
 			break;
 		}
 
 		//--------------------------------------------
 
-		case 'f': {		//	
-			
+		case 'f': {		//Fit the whole board in the window
+			viewFit(cellbuffer.width(), cellbuffer.height());
 			break;
 		}
 
@@ -1012,8 +1987,10 @@ void keyboard(unsigned char key, int x, int y) {
 
 		//--------------------------------------------
 
-		case 'h': {		//
-			
+		case 'h': {		//Toggle the age heatmap
+			setHeatmap(!toggle_heatmap);
+			printf("Heatmap | %s\n", (toggle_heatmap)? "On" : "Off" );
+			cout.flush();
 			break;
 		}
 
@@ -1041,8 +2018,8 @@ void keyboard(unsigned char key, int x, int y) {
 
 		//--------------------------------------------
 
-		case 'l': {		//		
-			
+		case 'l': {		//Reload the pattern file
+			if(pattern_name != "") loadPattern(pattern_name);
 			break;
 		}
 
@@ -1066,8 +2043,8 @@ void keyboard(unsigned char key, int x, int y) {
 
 		//--------------------------------------------
 
-		case 'o': {		//
-			
+		case 'o': {		//Restore the board snapshot
+			restoreSnapshot(snapshot_name, false);
 			break;
 		}
 
@@ -1109,8 +2086,8 @@ void keyboard(unsigned char key, int x, int y) {
 
 		//--------------------------------------------
 
-		case 's': {		//
-			
+		case 's': {		//Save a board snapshot
+			saveSnapshot(snapshot_name);
 			break;
 		}
 
@@ -1137,8 +2114,13 @@ void keyboard(unsigned char key, int x, int y) {
 
 		//--------------------------------------------
 
-		case 'v': {		//
-			
+		case 'v': {		//Toggle vsync
+			if(setVsync(!toggle_vsync)) {
+				toggle_vsync = !toggle_vsync;
+				printf("Vsync | %s\n", (toggle_vsync)? "On" : "Off" );
+			}
+			else printf("Vsync | Unsupported on this platform\n");
+			cout.flush();
 			break;
 		}
 
@@ -1153,8 +2135,11 @@ void keyboard(unsigned char key, int x, int y) {
 
 		//--------------------------------------------
 
-		case 'x': {		//
-			
+		case 'x': {		//Toggle resizing the board with the window
+			toggle_board_follow = !toggle_board_follow;
+			if(toggle_board_follow) reshape(ImageX, ImageY);
+			printf("Board Follows Window | %s\n", (toggle_board_follow)? "On" : "Off" );
+			cout.flush();
 			break;
 		}
 
@@ -1181,6 +2166,14 @@ void keyboard(unsigned char key, int x, int y) {
 		//--------------------------------------------
 
 		case 32: {		//Space bar
+			//Plays and pauses the replay instead of the simulation
+			if(player.is_open()) {
+				replay_playing = !replay_playing;
+				printf("Replay Status | %s\n", (replay_playing)? "Playing" : "Paused" );
+				cout.flush();
+				break;
+			}
+
 			toggle_simulation = !toggle_simulation;
 			if(toggle_simulation) {
 				survey();
@@ -1198,7 +2191,13 @@ void keyboard(unsigned char key, int x, int y) {
 		//--------------------------------------------
 
 		case 13: {		//Enter
-
+			//Leave the replay and simulate onwards from the shown generation
+			if(player.is_open()) {
+				player.close();
+				replay_playing = false;
+				printf("Replay | Closed, simulating from generation %i\n", generation_ct.load());
+				cout.flush();
+			}
 			break;
 		}
 
@@ -1219,9 +2218,7 @@ void keyboard(unsigned char key, int x, int y) {
 		//--------------------------------------------
 
 		case 27: {		//Esc
-			for(int i = 0; i < num_threads; i++) {
-				sim_threads[i].~thread();
-			}
+			stopSim();
 			exit(0);
 			break;
 		}
@@ -1248,12 +2245,17 @@ void specialKeyboard(int key, int x, int y) {
 	float dx = 0;
 	float dy = 0;
 	float dz = 0;
-	float d = grid_spacing;
+	float d = VIEW_PAN_STEP;
 
 	switch (key)
 	{
 		case GLUT_KEY_RIGHT: {		//Right Arrow Key
-			if(glutGetModifiers() == GLUT_ACTIVE_SHIFT) {
+			//Replay: step forward one generation (one keyframe interval with shift)
+			if(player.is_open()) {
+				replay_playing = false;
+				seekReplay(generation_ct + ((glutGetModifiers() == GLUT_ACTIVE_SHIFT)? (long long)player.header.keyframe_interval : 1));
+			}
+			else if(glutGetModifiers() == GLUT_ACTIVE_SHIFT) {
 				
 			}
 			else
@@ -1264,7 +2266,12 @@ void specialKeyboard(int key, int x, int y) {
 		//-------------------------------------------------------------------------------------------------------------------------
 
 		case GLUT_KEY_LEFT: {		//Left Arrow Key
-			if(glutGetModifiers() == GLUT_ACTIVE_SHIFT) {
+			//Replay: step back one generation (one keyframe interval with shift)
+			if(player.is_open()) {
+				replay_playing = false;
+				seekReplay(generation_ct - ((glutGetModifiers() == GLUT_ACTIVE_SHIFT)? (long long)player.header.keyframe_interval : 1));
+			}
+			else if(glutGetModifiers() == GLUT_ACTIVE_SHIFT) {
 				
 			}
 			else
@@ -1306,11 +2313,28 @@ void specialKeyboard(int key, int x, int y) {
 
 		//-------------------------------------------------------------------------------------------------------------------------
 
+		case GLUT_KEY_HOME: {		//Replay: jump to the first generation
+			if(player.is_open()) seekReplay(player.first_generation());
+			break;
+		}
+
+		case GLUT_KEY_END: {		//Replay: jump to the last generation
+			if(player.is_open()) seekReplay(player.last_generation);
+			break;
+		}
+
+		//-------------------------------------------------------------------------------------------------------------------------
+
 		case GLUT_KEY_F4: {
+			stopSim();
 			exit(0);
 			break;
 		}
 	}
+
+	//Arrows pan the view, [Shift]+[Up]/[Down] zooms it about the centre
+	if(dx != 0 || dy != 0) viewPan(dx, dy);
+	if(dz != 0) viewZoom((dz < 0)? VIEW_ZOOM_STEP : 1.0f / VIEW_ZOOM_STEP, ImageX / 2, ImageY / 2);
 	
 	glutPostRedisplay();
 }
@@ -1333,36 +2357,23 @@ void mouseMove(int x, int y) {
 
 	//-------------------------Left Mouse Button-------------------------------
 	if (mouse_left_pressed) {
-		spawn(x, y, dot_size);
-
-
-		//Rotate matrix
-		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
-
-		glRotatef(dx, 0, 1, 0);
-		glRotatef(dy, -1, 0, 0);
-
-		glMultMatrixf(rotationMatrix);
-		glGetFloatv(GL_MODELVIEW_MATRIX, rotationMatrix);
+		int cell_x, cell_y;
+		screenToBoard(x, y, cell_x, cell_y);
+		spawn(cell_x, cell_y, dot_size);
 	}
 
 	//-------------------------Right Mouse Button-------------------------------
 	if (mouse_right_pressed) {
-		//Compute zoom
-		if(toggle_look_at) {
-			camera.z += zoom_factor * dy;
-		}
-		else {
-			offset.z -= zoom_factor * dy;
-		}
+		//Drag the board along with the mouse
+		viewPan(-dx, -dy);
 	}
 
 	//Update previous mouse position
 	global_mouse_x = x;
 	global_mouse_y = y;
 
-	if(!CONTINUOUS_DISPLAY) glutPostRedisplay();
+	//Redrawn on the next frame timer tick, so dragging can't push the frame rate past the cap
+	frame_pending = true;
 }
 
 
@@ -1403,7 +2414,9 @@ void mouseClick(int btn, int state, int x, int y) {
 				fbRender();
 
 				//swap_buffer_idx = true;
-				spawn(x, y, dot_size);
+				int cell_x, cell_y;
+				screenToBoard(x, y, cell_x, cell_y);
+				spawn(cell_x, cell_y, dot_size);
 
 			}
 			else {   //Reset button state
@@ -1427,13 +2440,13 @@ void mouseClick(int btn, int state, int x, int y) {
 			}
 		}
 		else {
-			//Toggle mouse button pressed
+			//Toggle mouse button pressed (dragging pans the view)
 			if (state == GLUT_DOWN) {
-				mouse_left_pressed = true;
+				mouse_right_pressed = true;
 				
 			}
 			else {   //Reset button state
-				mouse_left_pressed = false;
+				mouse_right_pressed = false;
 
 			}
 		}
@@ -1441,27 +2454,21 @@ void mouseClick(int btn, int state, int x, int y) {
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
-	if (btn == 3) {		//Scroll wheel up
-		if(state == GLUT_ACTIVE_SHIFT) {
-
-		}
-		else {
-
+	if (btn == 3) {		//Scroll wheel up: zoom in about the mouse
+		if(state == GLUT_DOWN) {
+			viewZoom(VIEW_ZOOM_STEP, x, y);
 		}
 	}
 
 	//-------------------------------------------------------------------------------------------------------------------------
 
-	if (btn == 4) {		//Scroll wheel down
-		if(state == GLUT_ACTIVE_SHIFT) {
-
-		}
-		else {
-			
+	if (btn == 4) {		//Scroll wheel down: zoom out about the mouse
+		if(state == GLUT_DOWN) {
+			viewZoom(1.0f / VIEW_ZOOM_STEP, x, y);
 		}
 	}
 
-	if(!CONTINUOUS_DISPLAY) glutPostRedisplay();
+	frame_pending = true;
 }
 
 
@@ -1479,7 +2486,7 @@ void passiveMouseMove(int x, int y) {
 	global_mouse_x = x;
 	global_mouse_y = y;
 
-	if(!CONTINUOUS_DISPLAY) glutPostRedisplay();
+	//Nothing follows the cursor, so there is nothing to redraw
 }
 
 
@@ -1490,24 +2497,49 @@ void passiveMouseMove(int x, int y) {
 //=========================================================================================================================
 
 void reshape(int width, int height) {
-	//if(USE_FRAMEBUFFER) {
-	//	fbResize(width, height);
-	//	cellbuffer.resize(width, height, 2);
-	//}
+	//The board keeps its size and the view shows more or less of it, unless it follows the window. Dragging a window
+	//edge sends a stream of these, so the board size is only requested here and applied once per frame tick.
+	ImageX = width;
+	ImageY = height;
 	glViewMatrices();
+
+	if(toggle_board_follow) {
+		board_request_x = max(1, (int)(width / view_zoom));
+		board_request_y = max(1, (int)(height / view_zoom));
+	}
+	frame_pending = true;
 }
 
 //=========================================================================================================================
 //--------------------------------------------------Frame Redraw Timer-----------------------------------------------------
 //=========================================================================================================================
 
+//Redraws at most once per delay_time ms, and only when a generation was published, input changed the view or a replay
+//is playing. A paused board costs one check per tick.
 void updateFrameTimer(int value) {
-	if(CONTINUOUS_DISPLAY) glutPostRedisplay();
+	if(board_request_x > 0 && board_request_y > 0) {
+		resizeBoard(board_request_x, board_request_y);
+		board_request_x = board_request_y = 0;
+	}
+
+	if(CONTINUOUS_DISPLAY || frame_pending || (player.is_open() && replay_playing)) glutPostRedisplay();
 	glutTimerFunc(delay_time, updateFrameTimer, 0);
 }
 
-void idle(void) {
-	glutPostRedisplay();
+//Ties buffer swaps to the display refresh (swap interval 1) or lets them run free (0). Returns false where the platform
+//has no swap control, leaving the swap interval as it was.
+bool setVsync(bool on) {
+	GLint interval = (on)? 1 : 0;
+	#ifdef __APPLE__
+		return CGLSetParameter(CGLGetCurrentContext(), kCGLCPSwapInterval, &interval) == kCGLNoError;
+	#elif defined(_WIN32)
+		typedef BOOL (WINAPI *swap_interval_fn)(int);
+		swap_interval_fn swapInterval = (swap_interval_fn)wglGetProcAddress("wglSwapIntervalEXT");
+		return swapInterval != nullptr && swapInterval(interval);
+	#else
+		(void)interval;
+		return false;
+	#endif
 }
 
 //=========================================================================================================================
@@ -1565,6 +2597,14 @@ void initGL(void) {
 	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_CULL_FACE);
 
+	//Framebuffer rows are tightly packed bytes
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	fbPalette();
+
+	//About half the cores are left to the simulation
+	if(fill_threads < 0) fill_threads = min(3, max(0, (int)std::thread::hardware_concurrency() / 2 - 1));
+	fill_pool.start(fill_threads);
+
 	glutDisplayFunc(display);
 	glutKeyboardFunc(keyboard);
 	glutSpecialFunc(specialKeyboard);
@@ -1572,18 +2612,185 @@ void initGL(void) {
 	glutMouseFunc(mouseClick);
 	glutPassiveMotionFunc(passiveMouseMove);
 	glutReshapeFunc(reshape);
-	//glutTimerFunc(delay_time, updateFrameTimer, 0);
-	glutIdleFunc(idle);
+	glutTimerFunc(delay_time, updateFrameTimer, 0);
+
+	if(!setVsync(toggle_vsync) && toggle_vsync) {
+		toggle_vsync = false;
+		printf("Vsync | Unsupported on this platform\n");
+	}
 
 }
 
+//=========================================================================================================================
+//-----------------------------------------------------Command Line--------------------------------------------------------
+//=========================================================================================================================
+
+//Reads the program options. Anything not recognised is left for glutInit().
+void parseArgs(int argc, char** argv) {
+	for(int i = 1; i < argc; i++) {
+		string arg = argv[i];
+
+		if(arg == "--trace" && i + 1 < argc) {		//Record a timeline and write it as Chrome trace JSON at exit
+			trace_name = argv[++i];
+		}
+		else if(arg == "--load" && i + 1 < argc) {		//Start from an RLE pattern instead of random colonies
+			pattern_name = argv[++i];
+		}
+		else if(arg == "--save" && i + 1 < argc) {		//RLE file written by [e]
+			pattern_save_name = argv[++i];
+		}
+		else if(arg == "--snapshot" && i + 1 < argc) {	//Snapshot file written by [s] and restored by [o]
+			snapshot_name = argv[++i];
+		}
+		else if(arg == "--restore" && i + 1 < argc) {	//Resume from a snapshot, taking its board size
+			restore_name = argv[++i];
+		}
+		else if(arg == "--checkpoint-every" && i + 1 < argc) {	//Write a snapshot in the background every N generations
+			checkpoints.interval = atoi(argv[++i]);
+		}
+		else if(arg == "--checkpoint-keep" && i + 1 < argc) {	//Newest checkpoints kept on disk (0 keeps all)
+			checkpoints.keep = atoi(argv[++i]);
+		}
+		else if(arg == "--checkpoint-dir" && i + 1 < argc) {	//Directory for the checkpoint files
+			checkpoints.directory = argv[++i];
+		}
+		else if(arg == "--checkpoint-buffered") {				//Write checkpoints through the page cache
+			checkpoints.direct_io = false;
+		}
+		else if(arg == "--record" && i + 1 < argc) {				//Record every generation for replay
+			record_name = argv[++i];
+		}
+		else if(arg == "--record-keyframes" && i + 1 < argc) {		//Generations between full frames in the recording
+			recorder.keyframe_interval = atoi(argv[++i]);
+		}
+		else if(arg == "--replay" && i + 1 < argc) {				//Play back a recording instead of simulating
+			replay_name = argv[++i];
+		}
+		else if(arg == "--seek" && i + 1 < argc) {					//Generation the replay opens at
+			replay_seek = atoll(argv[++i]);
+		}
+		else if(arg == "--extract" && i + 1 < argc) {				//Write the --seek generation of the replay and exit
+			extract_name = argv[++i];
+		}
+		else if(arg == "--export" && i + 1 < argc) {				//Stream generations as Y4M/PGM frames to a file or "|command"
+			save_name = argv[++i];
+		}
+		else if(arg == "--export-every" && i + 1 < argc) {			//Generations between exported frames
+			exporter.every = atoi(argv[++i]);
+		}
+		else if(arg == "--export-scale" && i + 1 < argc) {			//Output pixels per cell
+			exporter.scale = atoi(argv[++i]);
+		}
+		else if(arg == "--bench" && i + 1 < argc) {		//Run headless for N generations and print a report
+			bench_generations = atoi(argv[++i]);
+		}
+		else if(arg == "--fps" && i + 1 < argc) {		//Frame rate cap
+			int fps = atoi(argv[++i]);
+			delay_time = (fps > 0)? max(1, 1000 / fps) : DELAY_TIME;
+		}
+		else if(arg == "--heatmap") {						//Start with the age heatmap shown
+			toggle_heatmap = true;
+		}
+		else if(arg == "--vsync") {						//Tie buffer swaps to the display refresh
+			toggle_vsync = true;
+		}
+		else if(arg == "--threads" && i + 1 < argc) {	//Number of simulation threads
+			num_threads = atoi(argv[++i]);
+			num_threads = (num_threads < 1)? 1 : num_threads;
+		}
+		else if(arg == "--follow-window") {				//Resize the board with the window
+			toggle_board_follow = true;
+		}
+		else if(arg == "--size" && i + 1 < argc) {		//Board size as WxH
+			int w = 0, h = 0;
+			if(sscanf(argv[++i], "%ix%i", &w, &h) == 2 && w > 0 && h > 0) {
+				fbResize(w, h);
+				if(!cellbuffer.resize(w, h, 2)) {
+					printf("Failed to allocate a %i x %i board\n", w, h);
+					exit(1);
+				}
+			}
+		}
+	}
+}
+
+//Runs on exit(). Stops the simulation so the trace rings are no longer being written.
+void exitHandler(void) {
+	stopSim();
+
+	//Finish any checkpoint that was already captured
+	if(checkpoints.enabled()) {
+		checkpoints.stop();
+		printf("Checkpoints | %i written, %i skipped, %i failed, %.3f s writing\n", checkpoints.completed.load(), checkpoints.skipped.load(), 
+				checkpoints.failed.load(), checkpoints.write_time_ns.load() * 1e-9);
+		cout.flush();
+	}
+
+	//Write the queued frames and close the pipe so the encoder can finish
+	if(exporter.is_open()) {
+		exporter.close();
+		printf("Frame export | %s: %llu frames, %llu dropped, %.1f MB written, %.3f s writing%s\n", save_name.c_str(), (unsigned long long)exporter.frames.load(), 
+				(unsigned long long)exporter.dropped.load(), exporter.written_bytes.load() / 1048576.0, exporter.write_time_ns.load() * 1e-9, (exporter.failed)? ", FAILED" : "");
+		cout.flush();
+	}
+
+	//Encode the queued generations and write the keyframe index
+	if(recorder.is_open()) {
+		recorder.close();
+		printf("Recording | %s: %llu frames (%llu keyframes), %llu dropped, %.1f MB written, %.1fx smaller than bit-packed, %.3f s encoding%s\n", 
+				record_name.c_str(), (unsigned long long)recorder.frames.load(), (unsigned long long)recorder.keyframes.load(), (unsigned long long)recorder.dropped.load(), 
+				recorder.written_bytes.load() / 1048576.0, recorder.ratio(), recorder.encode_time_ns.load() * 1e-9, (recorder.failed)? ", FAILED" : "");
+		cout.flush();
+	}
+
+	if(tracer.enabled()) {
+		tracer.enable(false);
+		if(tracer.write(trace_name.c_str())) printf("Wrote trace | %s\n", trace_name.c_str());
+		else printf("Failed to write trace | %s\n", trace_name.c_str());
+		cout.flush();
+	}
+}
+
 //=========================================================================================================================
 //---------------------------------------------------------Main------------------------------------------------------------
 //=========================================================================================================================
 
 int main(int argc, char** argv) {
-	initObj();
+	parseArgs(argc, argv);
+	atexit(exitHandler);
+
+	if(trace_name != "") {
+		tracer.enable(true);
+		tracer.name_thread("render");
+	}
+
+	if(replay_name != "") {
+		if(!openReplay(replay_name)) return 1;
+	}
+	else if(restore_name != "") {
+		if(!restoreSnapshot(restore_name, true)) return 1;
+	}
+	else if(pattern_name == "" || !loadPattern(pattern_name)) initObj();
 	initStaticObj();
+	viewFit(cellbuffer.width(), cellbuffer.height());
+	if(toggle_heatmap) setHeatmap(true);
+
+	checkpoints.start();
+	if(record_name != "") startRecording(record_name);
+	if(save_name != "") startExport(save_name);
+
+	//Headless extraction from a replay
+	if(player.is_open() && extract_name != "") {
+		bool snapshot = extract_name.size() > 5 && extract_name.compare(extract_name.size() - 5, 5, ".snap") == 0;
+		bool saved = (snapshot)? saveSnapshot(extract_name) : savePattern(extract_name);
+		return (saved)? 0 : 1;
+	}
+
+	//Headless benchmark
+	if(bench_generations > 0) {
+		runBench();
+		return 0;
+	}
 
 	//------------------------------------OpenGL-------------------------------------
 
@@ -1601,14 +2808,14 @@ int main(int argc, char** argv) {
 
 	
 	glutInitWindowPosition(100, 100);
-	glutCreateWindow(window_title_str);
+	window_id = glutCreateWindow(window_title_str);
 	
 	//Initialize the OpenL Window
 	initGL();
 
-	//Start the fps frame timer
-	fps_timer.start();
-	sps_timer.start();
+	//Start the metrics window
+	metrics_last = metrics.snapshot();
+	metrics_timer.start();
 	
 	glutMainLoop();
 
@@ -0,0 +1,263 @@
+/*
+Metrics class -- Low-overhead per-thread counters and latency histograms for the simulation hot paths
+Developed by: Travis Stewart
+*/
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#define METRICS_MAX_THREADS 64		//Live threads past this limit share one overflow slot with atomic adds
+#define METRICS_NUM_BUCKETS 40		//Bucket i holds samples in [2^i, 2^(i+1)) nanoseconds (~9 minutes max)
+
+enum METRIC_COUNTER{ GENERATIONS=0, CELL_UPDATES=1, FRAMES=2, EDITS=3, NUM_METRIC_COUNTERS=4 };
+enum METRIC_LATENCY{ STEP_TIME=0, BARRIER_WAIT=1, RENDER_UPLOAD=2, EDIT_APPLY=3, CHECKPOINT_COPY=4, RECORD_CAPTURE=5, EXPORT_CAPTURE=6, NUM_METRIC_LATENCIES=7 };
+
+static const char* metric_counter_names[NUM_METRIC_COUNTERS] = { "generations", "cell_updates", "frames", "edits" };
+static const char* metric_latency_names[NUM_METRIC_LATENCIES] = { "step_time", "barrier_wait", "render_upload", "edit_apply", "checkpoint_copy", "record_capture", "export_capture" };
+
+//Monotonic time in nanoseconds
+inline uint64_t metrics_now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Ids of exited threads, handed out again before new ones
+struct metrics_id_pool {
+	std::mutex mtx;
+	std::vector<int> free_ids;
+	int next_id = 0;
+};
+
+inline metrics_id_pool& metrics_ids() {
+	static metrics_id_pool pool;
+	return pool;
+}
+
+//Holds the calling thread's id and gives it back when the thread exits. The simulation threads are restarted by every
+//startSim(), so without reuse the ids would soon run past METRICS_MAX_THREADS.
+struct metrics_id_token {
+	int id;
+
+	metrics_id_token() {
+		metrics_id_pool& pool = metrics_ids();
+		std::lock_guard<std::mutex> lock(pool.mtx);
+		if(pool.free_ids.empty()) id = pool.next_id++;
+		else {
+			id = pool.free_ids.back();
+			pool.free_ids.pop_back();
+		}
+	}
+
+	~metrics_id_token() {
+		metrics_id_pool& pool = metrics_ids();
+		std::lock_guard<std::mutex> lock(pool.mtx);
+		pool.free_ids.push_back(id);
+	}
+};
+
+//Id for the calling thread, unique among the live threads. Assigned on first use.
+inline int metrics_thread_id() {
+	thread_local metrics_id_token token;
+	return token.id;
+}
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//Snapshot of the merged counters. Subtracting two snapshots gives the values for the window between them.
+struct metrics_snapshot {
+	double seconds;		//Time since the registry was created (or the window length for a delta)
+	uint64_t counters[NUM_METRIC_COUNTERS];
+	uint64_t buckets[NUM_METRIC_LATENCIES][METRICS_NUM_BUCKETS];
+	uint64_t total_ns[NUM_METRIC_LATENCIES];
+	uint64_t max_ns[NUM_METRIC_LATENCIES];		//Max since start, not per window
+
+	metrics_snapshot() { memset(this, 0, sizeof(metrics_snapshot)); }
+
+	//Window between two snapshots
+	metrics_snapshot operator - (const metrics_snapshot& prev) const {
+		metrics_snapshot s = *this;
+		s.seconds -= prev.seconds;
+		for(int c = 0; c < NUM_METRIC_COUNTERS; c++) s.counters[c] -= prev.counters[c];
+		for(int l = 0; l < NUM_METRIC_LATENCIES; l++) {
+			s.total_ns[l] -= prev.total_ns[l];
+			for(int b = 0; b < METRICS_NUM_BUCKETS; b++) s.buckets[l][b] -= prev.buckets[l][b];
+		}
+		return s;
+	}
+
+	//Counter value per second
+	inline double rate(int c) const { return (seconds > 0.0)? counters[c] / seconds : 0.0; }
+
+	//Number of latency samples
+	inline uint64_t count(int l) const { uint64_t n = 0; for(int b = 0; b < METRICS_NUM_BUCKETS; b++) n += buckets[l][b]; return n; }
+
+	//Mean latency in milliseconds
+	inline double mean(int l) const { uint64_t n = count(l); return (n)? (total_ns[l] / (double)n) * 1e-6 : 0.0; }
+
+	//Latency percentile in milliseconds, p in [0, 1]. Linearly interpolated inside the log2 bucket.
+	double percentile(int l, double p) const {
+		uint64_t n = count(l);
+		if(n == 0) return 0.0;
+
+		double rank = p * (n - 1) + 1;
+		uint64_t seen = 0;
+		for(int b = 0; b < METRICS_NUM_BUCKETS; b++) {
+			if(buckets[l][b] == 0) continue;
+			if(seen + buckets[l][b] >= rank) {
+				double lo = (b == 0)? 0.0 : (double)(1ull << b);
+				double hi = (double)(1ull << (b + 1));
+				double frac = (rank - seen) / buckets[l][b];
+				return (lo + (hi - lo) * frac) * 1e-6;
+			}
+			seen += buckets[l][b];
+		}
+		return max_ns[l] * 1e-6;
+	}
+
+	std::string info() const {
+		char line[256];
+		std::string rtn_str = "";
+		snprintf(line, sizeof(line), "[metrics] window %.3f s\n", seconds);
+		rtn_str += line;
+		for(int c = 0; c < NUM_METRIC_COUNTERS; c++) {
+			snprintf(line, sizeof(line), "\t%-14s %12llu  %14.1f /s\n", metric_counter_names[c], (unsigned long long)counters[c], rate(c));
+			rtn_str += line;
+		}
+		for(int l = 0; l < NUM_METRIC_LATENCIES; l++) {
+			snprintf(line, sizeof(line), "\t%-14s n=%-9llu mean %9.4f ms  p50 %9.4f ms  p99 %9.4f ms  max %9.4f ms\n", metric_latency_names[l],
+					(unsigned long long)count(l), mean(l), percentile(l, 0.5), percentile(l, 0.99), max_ns[l] * 1e-6);
+			rtn_str += line;
+		}
+		return rtn_str;
+	}
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//Each of the first METRICS_MAX_THREADS live threads writes only to its own cache line aligned slot, so its updates are
+//plain relaxed load/store pairs. Ids are reused once a thread exits, so a slot never has two writers. Any threads past
+//the limit all write to the extra overflow slot, which only takes atomic adds and a CAS loop for the maximum.
+//Readers merge all slots without locking; a snapshot may be a few samples behind the writers.
+class metrics_registry {
+private:
+	struct alignas(64) metric_slot {
+		std::atomic<uint64_t> counters[NUM_METRIC_COUNTERS];
+		std::atomic<uint64_t> buckets[NUM_METRIC_LATENCIES][METRICS_NUM_BUCKETS];
+		std::atomic<uint64_t> total_ns[NUM_METRIC_LATENCIES];
+		std::atomic<uint64_t> max_ns[NUM_METRIC_LATENCIES];
+	};
+
+	metric_slot slots[METRICS_MAX_THREADS + 1];		//The last one is the overflow slot
+	uint64_t start_ns;
+
+	//Single writer add. The overflow slot has many writers and needs a real RMW.
+	static inline void bump(std::atomic<uint64_t>& a, uint64_t v, bool shared) {
+		if(shared) a.fetch_add(v, std::memory_order_relaxed);
+		else a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+	}
+
+	//Largest value, v included. Shared slots need the CAS loop so a concurrent larger value isn't overwritten.
+	static inline void raise(std::atomic<uint64_t>& a, uint64_t v, bool shared) {
+		uint64_t m = a.load(std::memory_order_relaxed);
+		if(!shared) {
+			if(v > m) a.store(v, std::memory_order_relaxed);
+			return;
+		}
+		while(v > m && !a.compare_exchange_weak(m, v, std::memory_order_relaxed));
+	}
+
+	//Slot of the calling thread
+	static inline int slot_index(int id) { return (id < METRICS_MAX_THREADS)? id : METRICS_MAX_THREADS; }
+
+	static inline int bucket(uint64_t ns) {
+		int b = 63 - __builtin_clzll(ns | 1);
+		return (b < METRICS_NUM_BUCKETS)? b : METRICS_NUM_BUCKETS - 1;
+	}
+
+public:
+	metrics_registry() { reset(); }
+
+	//Not safe to call while other threads are recording
+	void reset() {
+		for(int t = 0; t <= METRICS_MAX_THREADS; t++) {
+			for(int c = 0; c < NUM_METRIC_COUNTERS; c++) slots[t].counters[c].store(0);
+			for(int l = 0; l < NUM_METRIC_LATENCIES; l++) {
+				for(int b = 0; b < METRICS_NUM_BUCKETS; b++) slots[t].buckets[l][b].store(0);
+				slots[t].total_ns[l].store(0);
+				slots[t].max_ns[l].store(0);
+			}
+		}
+		start_ns = metrics_now();
+	}
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	inline void add(int c, uint64_t v = 1) {
+		int t = slot_index(metrics_thread_id());
+		bump(slots[t].counters[c], v, t == METRICS_MAX_THREADS);
+	}
+
+	inline void record(int l, uint64_t ns) {
+		int t = slot_index(metrics_thread_id());
+		bool shared = t == METRICS_MAX_THREADS;
+		metric_slot& s = slots[t];
+
+		bump(s.buckets[l][bucket(ns)], 1, shared);
+		bump(s.total_ns[l], ns, shared);
+		raise(s.max_ns[l], ns, shared);
+	}
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Merge all thread slots
+	metrics_snapshot snapshot() const {
+		metrics_snapshot s;
+		s.seconds = (metrics_now() - start_ns) * 1e-9;
+		for(int t = 0; t <= METRICS_MAX_THREADS; t++) {
+			for(int c = 0; c < NUM_METRIC_COUNTERS; c++) s.counters[c] += slots[t].counters[c].load(std::memory_order_relaxed);
+			for(int l = 0; l < NUM_METRIC_LATENCIES; l++) {
+				for(int b = 0; b < METRICS_NUM_BUCKETS; b++) s.buckets[l][b] += slots[t].buckets[l][b].load(std::memory_order_relaxed);
+				s.total_ns[l] += slots[t].total_ns[l].load(std::memory_order_relaxed);
+				uint64_t m = slots[t].max_ns[l].load(std::memory_order_relaxed);
+				s.max_ns[l] = (m > s.max_ns[l])? m : s.max_ns[l];
+			}
+		}
+		return s;
+	}
+};
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Records the lifetime of the scope into a latency histogram
+struct metric_timer {
+	metrics_registry& registry;
+	int latency;
+	uint64_t t_begin;
+
+	metric_timer(metrics_registry& r, int l): registry(r), latency(l), t_begin(metrics_now()) {}
+	~metric_timer() { registry.record(latency, metrics_now() - t_begin); }
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
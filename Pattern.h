@@ -0,0 +1,281 @@
+/*
+Pattern functions -- Streaming Golly RLE (.rle) pattern reader and writer
+Developed by: Travis Stewart
+*/
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include "Util.h"
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#define PATTERN_CHUNK_SIZE (1 << 20)		//Bytes read from / written to disk per call
+#define RLE_LINE_LENGTH 70					//Maximum RLE body line length when writing
+
+//Life-like rule as birth/survival neighbour count bitmasks (bit n set = n neighbours)
+struct pattern_rule {
+	int birth = 1 << 3;
+	int survive = (1 << 2) | (1 << 3);
+};
+
+//Values from the pattern header
+struct pattern_info {
+	long long width = 0;
+	long long height = 0;
+	long long generation = 0;
+	bool has_rule = false;
+	pattern_rule rule;
+	string name = "";
+};
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//isspace/toupper for chars, which may be negative (bytes past 127 in a file)
+inline bool isSpaceChar(char c) { return isspace((unsigned char)c) != 0; }
+inline char upperChar(char c) { return (char)toupper((unsigned char)c); }
+
+//Parses "B3/S23", "b3s23" or the old "23/3" (survival/birth) notation. Returns false if the rule isn't life-like.
+inline bool parseRule(const string& str, pattern_rule& rule) {
+	pattern_rule r;
+	r.birth = r.survive = 0;
+
+	string s = str;
+	s.erase(remove_if(s.begin(), s.end(), isSpaceChar), s.end());
+	transform(s.begin(), s.end(), s.begin(), upperChar);
+	if(s == "") return false;
+
+	bool bs_notation = (s.find('B') != string::npos || s.find('S') != string::npos);
+	int* target = (bs_notation)? nullptr : &r.survive;
+	for(size_t i = 0; i < s.size(); i++) {
+		char c = s[i];
+		if(c == 'B') target = &r.birth;
+		else if(c == 'S') target = &r.survive;
+		else if(c == '/') target = (bs_notation)? target : &r.birth;
+		else if(c >= '0' && c <= '8' && target != nullptr) *target |= 1 << (c - '0');
+		else return false;
+	}
+
+	rule = r;
+	return true;
+}
+
+inline string ruleString(const pattern_rule& rule) {
+	string s = "B";
+	for(int n = 0; n <= 8; n++) if(rule.birth & (1 << n)) s += (char)('0' + n);
+	s += "/S";
+	for(int n = 0; n <= 8; n++) if(rule.survive & (1 << n)) s += (char)('0' + n);
+	return s;
+}
+
+//Reads "x = 3, y = 3, rule = B3/S23" using the tokenizer from Util.h
+inline void parseHeader(const string& line, pattern_info& info) {
+	vector<string> fields = split(line, ',');
+	for(size_t i = 0; i < fields.size(); i++) {
+		vector<string> kv = split(fields[i], '=');
+		if(kv.size() != 2) continue;
+
+		string key = kv[0];
+		key.erase(remove_if(key.begin(), key.end(), isSpaceChar), key.end());
+		if(key == "x") info.width = atoll(kv[1].c_str());
+		else if(key == "y") info.height = atoll(kv[1].c_str());
+		else if(key == "rule") info.has_rule = parseRule(kv[1], info.rule);
+	}
+}
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//Streams an RLE file and calls span(x, y, length) for every horizontal run of live cells, in pattern coordinates.
+//header(info) is called once the header line has been read, before the first span. Nothing is buffered beyond one
+//read chunk, so the file size isn't limited by memory. Cells in states > 1 (multi-state patterns) are treated as alive.
+template <class H, class F>
+bool readRLE(const char* file_name, pattern_info& info, H header, F span) {
+	FILE* file = fopen(file_name, "rb");
+	if(file == nullptr) return false;
+
+	vector<char> chunk(PATTERN_CHUNK_SIZE);
+	string line = "";				//Only used for the header and '#' lines
+	bool line_start = true;			//At the start of a line before the body begins
+	bool in_comment = false;		//Inside a '#' line
+	bool in_header = false;			//Inside the "x = ..." line
+	bool in_body = false;
+	bool done = false;
+
+	long long x = 0, y = 0, count = 0;
+	long long prefix_run = 0;		//Run of a two character multi-state tag ("pA" to "yO") waiting for its second character
+	size_t n;
+
+	while(!done && (n = fread(chunk.data(), 1, chunk.size(), file)) > 0) {
+		for(size_t i = 0; i < n && !done; i++) {
+			char c = chunk[i];
+
+			//------------------Header------------------
+			if(!in_body) {
+				if(in_comment || in_header) {
+					if(c == '\n' || c == '\r') {
+						if(in_header) {
+							parseHeader(line, info);
+							header(info);
+							in_body = true;
+						}
+						else if(line.size() > 1 && (line[1] == 'N')) info.name = line.substr((line.size() > 2)? 3 : 2);
+						else if(line.size() > 1 && (line[1] == 'r' || line[1] == 'R')) info.has_rule = parseRule(line.substr(2), info.rule);
+
+						in_comment = in_header = false;
+						line_start = true;
+						line = "";
+					}
+					else line += c;
+					continue;
+				}
+
+				if(line_start && c == '#') { in_comment = true; line = "#"; continue; }
+				if(line_start && c == 'x') { in_header = true; line = "x"; continue; }
+				if(isspace((unsigned char)c)) { line_start = (c == '\n' || c == '\r'); continue; }
+
+				//Body without a header line
+				header(info);
+				in_body = true;
+			}
+
+			//-------------------Body-------------------
+			if(c >= '0' && c <= '9') {
+				count = count * 10 + (c - '0');
+				continue;
+			}
+
+			if(isspace((unsigned char)c)) continue;		//Whitespace may split a count from its tag
+
+			long long run = (prefix_run > 0)? prefix_run : (count == 0)? 1 : count;
+			count = prefix_run = 0;
+
+			if(c >= 'p' && c <= 'y') prefix_run = run;		//The state is only complete with the next character
+			else if(c == 'b' || c == '.') x += run;
+			else if(c == '$') { y += run; x = 0; }
+			else if(c == '!') done = true;
+			else { span(x, y, run); x += run; }		//'o' and multi-state tags
+		}
+	}
+
+	//Pattern was only a header
+	if(!in_body) {
+		if(in_header) parseHeader(line, info);
+		header(info);
+	}
+
+	fclose(file);
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Buffered RLE output. Tokens are appended to a fixed chunk that is flushed to disk when full.
+class rle_writer {
+private:
+	FILE* file;
+	vector<char> chunk;
+	size_t used;
+	int line_length;
+	char pending_tag;		//Run waiting to be merged with the next run of the same tag
+	long long pending_count;
+	long long pending_dead;	//Dead cells are only written if a live cell follows them on the same row
+	bool failed;			//A write failed (e.g. the disk is full)
+
+	inline void put(const char* s, size_t len) {
+		if(used + len > chunk.size()) flush();
+		memcpy(chunk.data() + used, s, len);
+		used += len;
+	}
+
+	void emit(char tag, long long count) {
+		char token[32];
+		int len = (count > 1)? snprintf(token, sizeof(token), "%lld%c", count, tag) : snprintf(token, sizeof(token), "%c", tag);
+		if(line_length + len > RLE_LINE_LENGTH) { put("\n", 1); line_length = 0; }
+		put(token, len);
+		line_length += len;
+	}
+
+public:
+	rle_writer(): file(nullptr), chunk(PATTERN_CHUNK_SIZE), used(0), line_length(0), pending_tag(0), pending_count(0), pending_dead(0), failed(false) {}
+	~rle_writer() { close(); }
+
+	bool open(const char* file_name, long long width, long long height, const pattern_rule& rule) {
+		file = fopen(file_name, "wb");
+		if(file == nullptr) return false;
+		failed = false;
+
+		char header[256];
+		int len = snprintf(header, sizeof(header), "#C Generated by Game of Life Simulation\nx = %lld, y = %lld, rule = %s\n", width, height, ruleString(rule).c_str());
+		put(header, len);
+		return true;
+	}
+
+	//Append a run of 'o' (alive), 'b' (dead) or '$' (end of row). Dead runs at the end of a row are dropped.
+	inline void run(char tag, long long count) {
+		if(count <= 0) return;
+		if(tag == 'b') { pending_dead += count; return; }
+		if(tag == '$') pending_dead = 0;
+
+		if(pending_dead > 0) {
+			if(pending_count > 0) emit(pending_tag, pending_count);
+			emit('b', pending_dead);
+			pending_tag = 0;
+			pending_count = pending_dead = 0;
+		}
+
+		if(tag == pending_tag) { pending_count += count; return; }
+		if(pending_count > 0) emit(pending_tag, pending_count);
+		pending_tag = tag;
+		pending_count = count;
+	}
+
+	inline void flush() {
+		if(file != nullptr && used > 0 && fwrite(chunk.data(), 1, used, file) != used) failed = true;
+		used = 0;
+	}
+
+	//Returns false if anything failed to reach the file
+	bool close() {
+		if(file == nullptr) return !failed;
+		if(pending_count > 0 && pending_tag != '$') emit(pending_tag, pending_count);
+		put("!\n", 2);
+		flush();
+		if(fflush(file) != 0 || ferror(file)) failed = true;
+		if(fclose(file) != 0) failed = true;
+		file = nullptr;
+		pending_tag = 0;
+		pending_count = pending_dead = 0;
+		return !failed;
+	}
+};
+
+//Writes a width x height region as RLE. cell(x, y) returns whether the cell is alive.
+template <class F>
+bool writeRLE(const char* file_name, long long width, long long height, const pattern_rule& rule, F cell) {
+	rle_writer writer;
+	if(!writer.open(file_name, width, height, rule)) return false;
+
+	for(long long y = 0; y < height; y++) {
+		long long x = 0;
+		while(x < width) {
+			bool alive = cell(x, y);
+			long long start = x;
+			while(x < width && cell(x, y) == alive) x++;
+			writer.run((alive)? 'o' : 'b', x - start);
+		}
+		if(y + 1 < height) writer.run('$', 1);
+	}
+
+	return writer.close();
+}
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
@@ -0,0 +1,175 @@
+/*
+PerfCounters class -- Hardware performance counters through Linux perf_event_open (no-op on other platforms)
+Developed by: Travis Stewart
+*/
+
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+enum PERF_EVENT{ PERF_CYCLES=0, PERF_INSTRUCTIONS=1, PERF_L1D_MISSES=2, PERF_LLC_MISSES=3, PERF_BRANCH_MISSES=4, PERF_NUM_EVENTS=5 };
+
+static const char* perf_event_names[PERF_NUM_EVENTS] = { "cycles", "instructions", "L1D-misses", "LLC-misses", "branch-misses" };
+
+//Counter values. Events the CPU/kernel refused to count are marked invalid. A reading from perf_counters::read()
+//holds the raw running totals; subtracting two readings gives the window between them, scaled up by that window's
+//own enabled/running ratio if the kernel had to multiplex the counters. Windows are then summed with +=.
+struct perf_sample {
+	uint64_t value[PERF_NUM_EVENTS];
+	bool valid[PERF_NUM_EVENTS];
+	uint64_t time_enabled, time_running;	//Nanoseconds the counter group was enabled and actually counting
+	int samples;							//Windows summed into this one
+
+	perf_sample() { clear(); }
+
+	inline void clear() { 
+		for(int e = 0; e < PERF_NUM_EVENTS; e++) { value[e] = 0; valid[e] = false; } 
+		time_enabled = time_running = 0;
+		samples = 0;
+	}
+
+	inline perf_sample operator - (const perf_sample& s) const {
+		perf_sample t;
+		t.time_enabled = time_enabled - s.time_enabled;
+		t.time_running = time_running - s.time_running;
+		t.samples = 1;
+		double scale = (t.time_running > 0 && t.time_running < t.time_enabled)? (double)t.time_enabled / t.time_running : 1.0;
+		for(int e = 0; e < PERF_NUM_EVENTS; e++) { 
+			t.value[e] = (uint64_t)((value[e] - s.value[e]) * scale); 
+			t.valid[e] = valid[e] && s.valid[e]; 
+		}
+		return t;
+	}
+
+	//An event is only valid if it was counted in every window
+	inline void operator += (const perf_sample& s) {
+		for(int e = 0; e < PERF_NUM_EVENTS; e++) { 
+			value[e] += s.value[e]; 
+			valid[e] = (samples == 0)? s.valid[e] : valid[e] && s.valid[e]; 
+		}
+		time_enabled += s.time_enabled;
+		time_running += s.time_running;
+		samples += (s.samples > 0)? s.samples : 1;
+	}
+
+	inline double ipc() const { return (valid[PERF_CYCLES] && valid[PERF_INSTRUCTIONS] && value[PERF_CYCLES])? (double)value[PERF_INSTRUCTIONS] / value[PERF_CYCLES] : 0.0; }
+};
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Counts user space events of the calling thread only. Open one set per thread you want to measure.
+class perf_counters {
+private:
+	int fds[PERF_NUM_EVENTS];
+	uint64_t ids[PERF_NUM_EVENTS];		//Kernel event ids, used to match the values of a group read
+	int leader;
+	bool opened;
+
+#ifdef __linux__
+	static int open_event(uint32_t type, uint64_t config, int group_fd) {
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = type;
+		attr.config = config;
+		attr.disabled = (group_fd == -1)? 1 : 0;	//The leader starts the whole group
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+	}
+#endif
+
+public:
+	perf_counters(): leader(-1), opened(false) { for(int e = 0; e < PERF_NUM_EVENTS; e++) { fds[e] = -1; ids[e] = 0; } }
+	~perf_counters() { close(); }
+
+	inline bool is_open() const { return opened; }
+
+	//Returns false if nothing could be opened (non-Linux, no PMU in a VM, or perf_event_paranoid too strict)
+	bool open() {
+		close();
+#ifdef __linux__
+		fds[PERF_CYCLES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+		if(fds[PERF_CYCLES] < 0) {
+			fds[PERF_CYCLES] = -1;
+			return false;
+		}
+		leader = fds[PERF_CYCLES];
+
+		fds[PERF_INSTRUCTIONS] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, leader);
+		fds[PERF_L1D_MISSES] = open_event(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), leader);
+		fds[PERF_LLC_MISSES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, leader);
+		fds[PERF_BRANCH_MISSES] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, leader);
+
+		for(int e = 0; e < PERF_NUM_EVENTS; e++) {
+			if(fds[e] >= 0 && ioctl(fds[e], PERF_EVENT_IOC_ID, &ids[e]) != 0) {
+				::close(fds[e]);
+				fds[e] = -1;
+			}
+		}
+
+		ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		opened = true;
+#endif
+		return opened;
+	}
+
+	void close() {
+#ifdef __linux__
+		for(int e = 0; e < PERF_NUM_EVENTS; e++) if(fds[e] >= 0) ::close(fds[e]);
+#endif
+		for(int e = 0; e < PERF_NUM_EVENTS; e++) fds[e] = -1;
+		leader = -1;
+		opened = false;
+	}
+
+	//Reads the whole group with one syscall. The values are raw totals, see perf_sample for the scaling.
+	perf_sample read() const {
+		perf_sample s;
+#ifdef __linux__
+		if(!opened) return s;
+
+		uint64_t buf[3 + 2 * PERF_NUM_EVENTS];		//nr, time_enabled, time_running, {value, id} * nr
+		if(::read(leader, buf, sizeof(buf)) <= 0) return s;
+
+		uint64_t nr = buf[0];
+		s.time_enabled = buf[1];
+		s.time_running = buf[2];
+		for(uint64_t i = 0; i < nr; i++) {
+			uint64_t id = buf[3 + 2 * i + 1];
+			for(int e = 0; e < PERF_NUM_EVENTS; e++) {
+				if(fds[e] >= 0 && ids[e] == id) {
+					s.value[e] = buf[3 + 2 * i];
+					s.valid[e] = true;
+				}
+			}
+		}
+#endif
+		return s;
+	}
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
@@ -0,0 +1,612 @@
+/*
+Recording class -- Whole-run recording as compressed XOR deltas between generations, with periodic keyframes
+Developed by: Travis Stewart
+*/
+
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include "Snapshot.h"
+
+#include <stdio.h>
+#include <limits.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//File layout:
+//	recording_header
+//	frames, each a recording_frame followed by compressed_bytes of zlib data
+//	keyframe index: uint64 count, then count x { uint64 generation, uint64 file offset of the frame }
+//	recording_trailer (offset of the index), so the index can be found from the end of the file
+//A frame is the board bit-packed into ceil(width / 64) words per row (row 0 first), XORed with the previous frame
+//unless it's a keyframe, then run-length encoded as word tokens (see recordingEncode) and compressed.
+//A recording cut short (crash) has no index or trailer; readers rebuild the index by scanning the frames.
+
+#define RECORDING_MAGIC "GOLREC01"
+#define RECORDING_INDEX_MAGIC "GOLRIDX1"
+#define RECORDING_VERSION 2				//2: 64 bit frame sizes
+#define RECORDING_FILE_BUFFER (8 << 20)		//stdio buffer for the output file
+
+enum RECORDING_FRAME{ RECORDING_KEYFRAME=0, RECORDING_DELTA=1 };
+
+struct recording_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t keyframe_interval;		//Frames between keyframes
+	uint64_t width;
+	uint64_t height;
+	int32_t rule_birth;				//Neighbour count bitmasks, see pattern_rule
+	int32_t rule_survive;
+	uint64_t first_generation;
+};
+
+struct recording_frame {
+	uint64_t generation;
+	uint64_t population;
+	uint32_t type;					//RECORDING_FRAME
+	uint32_t reserved;
+	uint64_t raw_bytes;				//Run-length encoded size before compression
+	uint64_t compressed_bytes;
+};
+
+struct recording_trailer {
+	uint64_t index_offset;
+	char magic[8];
+};
+
+inline uint64_t recordingRowWords(uint64_t width) { return (width + 63) / 64; }
+
+//64 bit file positions. fseeko/ftello are POSIX; the Windows CRT has _fseeki64/_ftelli64 instead.
+inline bool recordingSeek(FILE* file, uint64_t offset, int whence) {
+#if defined(_WIN32)
+	return _fseeki64(file, (long long)offset, whence) == 0;
+#else
+	return fseeko(file, (off_t)offset, whence) == 0;
+#endif
+}
+
+//Returns UINT64_MAX on failure
+inline uint64_t recordingTell(FILE* file) {
+#if defined(_WIN32)
+	long long pos = _ftelli64(file);
+#else
+	long long pos = ftello(file);
+#endif
+	return (pos < 0)? UINT64_MAX : (uint64_t)pos;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+inline void putVarint(std::vector<uint8_t>& out, uint64_t v) {
+	while(v >= 0x80) { out.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+	out.push_back((uint8_t)v);
+}
+
+inline bool getVarint(const uint8_t*& p, const uint8_t* end, uint64_t& v) {
+	v = 0;
+	for(int shift = 0; p < end && shift < 64; shift += 7) {
+		uint8_t b = *p++;
+		v |= (uint64_t)(b & 0x7F) << shift;
+		if(!(b & 0x80)) return true;
+	}
+	return false;
+}
+
+//Run-length encodes n words as repeated tokens of varint(zero words), varint(literal words), literal words.
+//A delta between neighbouring generations is almost all zero words, so it shrinks to a few bytes per active region.
+inline void recordingEncode(const uint64_t* words, size_t n, std::vector<uint8_t>& out) {
+	out.clear();
+	size_t i = 0;
+	while(i < n) {
+		size_t zeros = 0;
+		while(i + zeros < n && words[i + zeros] == 0) zeros++;
+		i += zeros;
+
+		size_t literals = 0;
+		while(i + literals < n && words[i + literals] != 0) literals++;
+
+		putVarint(out, zeros);
+		putVarint(out, literals);
+		size_t pos = out.size();
+		out.resize(pos + literals * sizeof(uint64_t));
+		memcpy(out.data() + pos, words + i, literals * sizeof(uint64_t));
+		i += literals;
+	}
+}
+
+//Largest encoding of n words: every token carries two varints of at most 10 bytes, and every token but the first
+//and last covers at least one zero and one literal word
+inline uint64_t recordingMaxEncoded(uint64_t n) { return n * sizeof(uint64_t) + 20 * (n / 2 + 2); }
+
+//XORs (delta) or copies (keyframe) the decoded words into words. Returns false on malformed input.
+inline bool recordingDecode(const uint8_t* p, size_t bytes, uint64_t* words, size_t n, bool delta) {
+	const uint8_t* end = p + bytes;
+	size_t i = 0;
+	if(!delta) memset(words, 0, n * sizeof(uint64_t));
+	while(p < end) {
+		uint64_t zeros, literals;
+		if(!getVarint(p, end, zeros) || !getVarint(p, end, literals)) return false;
+		if(zeros > n - i || literals > n - i - zeros || (size_t)(end - p) < literals * sizeof(uint64_t)) return false;
+		i += zeros;
+		for(uint64_t k = 0; k < literals; k++, i++, p += sizeof(uint64_t)) {
+			uint64_t w;
+			memcpy(&w, p, sizeof(uint64_t));
+			words[i] = (delta)? words[i] ^ w : w;
+		}
+	}
+	return true;
+}
+
+//zlib's one-shot compress2/uncompress take uLong sizes, which are 32 bits on Windows, and a frame of a large board
+//can pass 4 GB. Frames are streamed through deflate/inflate instead, at most UINT_MAX bytes per call.
+
+//Compresses bytes of src into out (grown as needed), setting out_bytes. Returns false on a zlib error.
+inline bool recordingCompress(const uint8_t* src, size_t bytes, std::vector<uint8_t>& out, size_t& out_bytes) {
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(deflateInit(&zs, Z_BEST_SPEED) != Z_OK) return false;
+
+	out_bytes = 0;
+	if(out.size() < (1 << 16)) out.resize(1 << 16);
+	int status = Z_OK;
+	while(status == Z_OK) {
+		if(out_bytes == out.size()) out.resize(out.size() * 2);
+		size_t in_chunk = std::min(bytes, (size_t)UINT_MAX), out_chunk = std::min(out.size() - out_bytes, (size_t)UINT_MAX);
+		zs.next_in = (Bytef*)src;
+		zs.avail_in = (uInt)in_chunk;
+		zs.next_out = out.data() + out_bytes;
+		zs.avail_out = (uInt)out_chunk;
+		status = deflate(&zs, (in_chunk == bytes)? Z_FINISH : Z_NO_FLUSH);
+		src += in_chunk - zs.avail_in;
+		bytes -= in_chunk - zs.avail_in;
+		out_bytes += out_chunk - zs.avail_out;
+	}
+	deflateEnd(&zs);
+	return status == Z_STREAM_END;
+}
+
+//Decompresses bytes of src into dst, which holds dst_bytes. Returns false unless the stream ends exactly there.
+inline bool recordingUncompress(const uint8_t* src, size_t bytes, uint8_t* dst, size_t dst_bytes) {
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	if(inflateInit(&zs) != Z_OK) return false;
+
+	//Once dst is full inflate still needs room to reach the end of the stream. Anything it puts in spare is excess.
+	uint8_t spare;
+	int status = Z_OK;
+	while(status == Z_OK) {
+		size_t in_chunk = std::min(bytes, (size_t)UINT_MAX), out_chunk = std::min(dst_bytes, (size_t)UINT_MAX);
+		zs.next_in = (Bytef*)src;
+		zs.avail_in = (uInt)in_chunk;
+		zs.next_out = (out_chunk > 0)? dst : &spare;
+		zs.avail_out = (out_chunk > 0)? (uInt)out_chunk : 1;
+		status = inflate(&zs, Z_NO_FLUSH);
+		if(out_chunk == 0 && zs.avail_out == 0) status = Z_DATA_ERROR;
+		src += in_chunk - zs.avail_in;
+		bytes -= in_chunk - zs.avail_in;
+		if(out_chunk > 0) {
+			dst += out_chunk - zs.avail_out;
+			dst_bytes -= out_chunk - zs.avail_out;
+		}
+	}
+	inflateEnd(&zs);
+	return status == Z_STREAM_END && dst_bytes == 0;
+}
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//The simulation copies each generation into a queue slot (one memcpy) and carries on. An encoder thread packs,
+//XORs, encodes, compresses (zlib level 1) and writes the frames in order. If the encoder falls a whole queue behind,
+//generations are dropped rather than stalling the simulation, and the next frame written is a keyframe.
+class recording_writer {
+private:
+	struct recording_slot {
+		std::vector<char> cells;		//One byte per cell, a copy of a contiguous bool plane
+		uint64_t generation = 0;
+		bool key = false;				//Generations were dropped before this one
+	};
+
+	std::vector<recording_slot> slots;
+	size_t head = 0, count = 0;			//Oldest captured slot and number waiting
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::thread worker;
+	bool running = false;
+
+	FILE* file = nullptr;
+	std::vector<char> file_buffer;
+	recording_header header;
+	uint64_t last_generation = 0;
+	bool captured = false;				//last_generation is valid
+	bool gap = true;					//Next captured frame must be a keyframe
+
+	//Encoder state, only touched by the worker
+	std::vector<uint64_t> current, previous, delta;
+	std::vector<uint8_t> encoded, compressed;
+	std::vector<uint64_t> index;		//generation, offset pairs
+	uint64_t frames_since_key = 0;
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mtx);
+		while(true) {
+			if(count == 0) {
+				if(!running) return;
+				cv.wait(lock);
+				continue;
+			}
+
+			//The slot belongs to this thread until it's released
+			recording_slot& slot = slots[head];
+			lock.unlock();
+			encode(slot);
+			lock.lock();
+			head = (head + 1) % slots.size();
+			count--;
+		}
+	}
+
+	void encode(const recording_slot& slot) {
+		//Every frame after a failed one would be a delta against a frame that isn't in the file
+		if(failed) return;
+
+		size_t row_words = recordingRowWords(header.width);
+		size_t n = row_words * header.height;
+		const bool* cells = (const bool*)slot.cells.data();
+
+		std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+
+		uint64_t population = 0;
+		for(uint64_t j = 0; j < header.height; j++) {
+			uint64_t* row = current.data() + j * row_words;
+			packRow(cells + j * header.width, 1, header.width, row, row_words);
+			for(size_t w = 0; w < row_words; w++) population += __builtin_popcountll(row[w]);
+		}
+
+		//Keyframes on the interval, and whenever the chain was broken by dropped generations
+		bool key = slot.key || frames_since_key >= header.keyframe_interval;
+		if(key) recordingEncode(current.data(), n, encoded);
+		else {
+			for(size_t w = 0; w < n; w++) delta[w] = current[w] ^ previous[w];
+			recordingEncode(delta.data(), n, encoded);
+		}
+		current.swap(previous);
+
+		size_t compressed_size = 0;
+		if(!recordingCompress(encoded.data(), encoded.size(), compressed, compressed_size)) {
+			failed = true;
+			return;
+		}
+
+		recording_frame frame;
+		memset(&frame, 0, sizeof(frame));
+		frame.generation = slot.generation;
+		frame.population = population;
+		frame.type = (key)? RECORDING_KEYFRAME : RECORDING_DELTA;
+		frame.raw_bytes = encoded.size();
+		frame.compressed_bytes = compressed_size;
+
+		if(key) {
+			uint64_t offset = recordingTell(file);
+			if(offset == UINT64_MAX) {
+				failed = true;
+				return;
+			}
+			index.push_back(frame.generation);
+			index.push_back(offset);
+			keyframes++;
+			frames_since_key = 0;
+		}
+		frames_since_key++;
+
+		if(fwrite(&frame, sizeof(frame), 1, file) != 1 || fwrite(compressed.data(), 1, compressed_size, file) != compressed_size) failed = true;
+
+		frames++;
+		raw_bytes += n * sizeof(uint64_t);
+		written_bytes += sizeof(frame) + compressed_size;
+		encode_time_ns += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+	}
+
+public:
+	//Configuration. Set before open().
+	int keyframe_interval = 1000;
+	int queue_depth = 8;			//Captured generations that can wait for the encoder before generations are dropped
+
+	//Statistics
+	std::atomic<uint64_t> frames{0};
+	std::atomic<uint64_t> keyframes{0};
+	std::atomic<uint64_t> dropped{0};			//Generations not recorded because the queue was full
+	std::atomic<uint64_t> raw_bytes{0};			//Bit-packed size of the recorded frames
+	std::atomic<uint64_t> written_bytes{0};
+	std::atomic<uint64_t> encode_time_ns{0};
+	std::atomic<bool> failed{false};
+
+	~recording_writer() { close(); }
+
+	inline bool is_open() const { return file != nullptr; }
+
+	//Starts a recording of a width x height board and its encoder thread
+	bool open(const char* file_name, uint64_t width, uint64_t height, int birth, int survive, uint64_t generation) {
+		close();
+		file = fopen(file_name, "wb");
+		if(file == nullptr) return false;
+		file_buffer.resize(RECORDING_FILE_BUFFER);
+		setvbuf(file, file_buffer.data(), _IOFBF, file_buffer.size());
+
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, RECORDING_MAGIC, 8);
+		header.version = RECORDING_VERSION;
+		header.keyframe_interval = (keyframe_interval > 0)? keyframe_interval : 1;
+		header.width = width;
+		header.height = height;
+		header.rule_birth = birth;
+		header.rule_survive = survive;
+		header.first_generation = generation;
+		if(fwrite(&header, sizeof(header), 1, file) != 1) {
+			fclose(file);
+			file = nullptr;
+			return false;
+		}
+
+		size_t n = recordingRowWords(width) * height;
+		current.assign(n, 0);
+		previous.assign(n, 0);
+		delta.assign(n, 0);
+		index.clear();
+		frames_since_key = 0;
+
+		slots.assign((queue_depth > 0)? queue_depth : 1, recording_slot());
+		head = count = 0;
+		last_generation = 0;
+		captured = false;
+		gap = true;
+		failed = false;
+
+		running = true;
+		worker = std::thread(&recording_writer::run, this);
+		return true;
+	}
+
+	//Copies a contiguous width x height plane of cells for the given generation. Call while the plane can't change
+	//(e.g. inside the generation barrier). Never blocks on the encoder; the generation is dropped if every slot is
+	//still queued. Generations must increase and the size must match the recording, anything else (e.g. a reset or
+	//resized board) is ignored.
+	bool capture(const bool* plane, uint64_t width, uint64_t height, uint64_t generation) {
+		std::unique_lock<std::mutex> lock(mtx);
+		if(!running || width != header.width || height != header.height || (captured && generation <= last_generation)) return false;
+
+		if(count == slots.size()) {
+			dropped++;
+			gap = true;
+			return false;
+		}
+
+		recording_slot& slot = slots[(head + count) % slots.size()];
+		slot.cells.resize(header.width * header.height);
+		memcpy(slot.cells.data(), plane, header.width * header.height);
+		slot.generation = generation;
+		slot.key = gap;
+		last_generation = generation;
+		captured = true;
+		gap = false;
+		count++;
+
+		lock.unlock();
+		cv.notify_one();
+		return true;
+	}
+
+	//Encodes everything captured, then writes the keyframe index and trailer
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if(!running) return;
+			running = false;
+		}
+		cv.notify_all();
+		if(worker.joinable()) worker.join();
+
+		recording_trailer trailer;
+		trailer.index_offset = recordingTell(file);
+		memcpy(trailer.magic, RECORDING_INDEX_MAGIC, 8);
+		if(trailer.index_offset == UINT64_MAX) failed = true;
+
+		//Readers fall back to scanning the frames when the index is missing, but a short write is still reported
+		uint64_t num_keys = index.size() / 2;
+		if(fwrite(&num_keys, sizeof(num_keys), 1, file) != 1
+			|| (num_keys > 0 && fwrite(index.data(), sizeof(uint64_t), index.size(), file) != index.size())
+			|| fwrite(&trailer, sizeof(trailer), 1, file) != 1) failed = true;
+
+		if(fclose(file) != 0) failed = true;
+		file = nullptr;
+	}
+
+	inline double ratio() const { return (written_bytes > 0)? (double)raw_bytes / written_bytes : 0.0; }
+};
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+struct recording_key {
+	uint64_t generation;
+	uint64_t offset;
+};
+
+//Plays a recording back. The keyframe index comes from the end of the file, or from a scan of the frame headers if
+//the recording was cut short. Seeking decodes from the nearest keyframe at or before the target, so it costs at most
+//one keyframe interval of frames however long the run is.
+class recording_reader {
+private:
+	FILE* file;
+	uint64_t data_end;				//Frames stop here (the index offset, or the end of the last complete frame)
+	uint64_t next_offset;			//Next frame to decode
+	bool decoded;					//words holds a frame
+	uint64_t* words;				//num_words packed words, nullptr if the board didn't fit in memory
+	size_t num_words;
+	std::vector<uint8_t> encoded, compressed;
+
+	bool read_at(uint64_t offset, void* p, size_t bytes) {
+		return recordingSeek(file, offset, SEEK_SET) && fread(p, 1, bytes, file) == bytes;
+	}
+
+	//Rebuilds the index from the frame headers. Stops at the first incomplete frame, or one that doesn't come after
+	//the previous generation.
+	void scan(uint64_t offset, uint64_t file_size) {
+		recording_frame f;
+		bool first = true;
+		while(file_size - offset >= sizeof(f) && read_at(offset, &f, sizeof(f)) && f.compressed_bytes <= file_size - offset - sizeof(f)
+			&& (first || f.generation > last_generation)) {
+			if(f.type == RECORDING_KEYFRAME && (keys.empty() || keys.back().offset < offset)) keys.push_back({ f.generation, offset });
+			first = false;
+			last_generation = f.generation;
+			offset += sizeof(f) + f.compressed_bytes;
+		}
+		data_end = offset;
+	}
+
+public:
+	recording_header header;
+	recording_frame frame;			//Header of the decoded frame
+	std::vector<recording_key> keys;
+	uint64_t last_generation;
+
+	recording_reader(): file(nullptr), data_end(0), next_offset(0), decoded(false), words(nullptr), num_words(0), last_generation(0) { memset(&header, 0, sizeof(header)); memset(&frame, 0, sizeof(frame)); }
+	~recording_reader() { close(); }
+
+	bool open(const char* file_name) {
+		close();
+		file = fopen(file_name, "rb");
+		if(file == nullptr) return false;
+
+		//Everything below comes from the file. The board must have int coordinates and its packed words a size_t size.
+		uint64_t file_size = (recordingSeek(file, 0, SEEK_END))? recordingTell(file) : UINT64_MAX;
+		if(file_size == UINT64_MAX || !read_at(0, &header, sizeof(header)) || memcmp(header.magic, RECORDING_MAGIC, 8) != 0 || header.version != RECORDING_VERSION
+			|| header.width == 0 || header.height == 0 || header.width > INT_MAX || header.height > INT_MAX
+			|| recordingRowWords(header.width) > SIZE_MAX / sizeof(uint64_t) / header.height) {
+			close();
+			return false;
+		}
+
+		//Index written by recording_writer::close(). The keys must point at frames in order, otherwise the frames are scanned.
+		recording_trailer trailer;
+		uint64_t num_keys = 0;
+		const uint64_t index_end = file_size - sizeof(trailer) - sizeof(num_keys);
+		bool indexed = file_size >= sizeof(header) + sizeof(trailer) + sizeof(num_keys) && read_at(file_size - sizeof(trailer), &trailer, sizeof(trailer))
+				&& memcmp(trailer.magic, RECORDING_INDEX_MAGIC, 8) == 0 && trailer.index_offset >= sizeof(header) && trailer.index_offset <= index_end
+				&& read_at(trailer.index_offset, &num_keys, sizeof(num_keys)) && num_keys <= (index_end - trailer.index_offset) / sizeof(recording_key)
+				&& num_keys * sizeof(recording_key) == index_end - trailer.index_offset;
+		if(indexed) {
+			keys.resize(num_keys);
+			indexed = num_keys == 0 || fread(keys.data(), sizeof(recording_key), num_keys, file) == num_keys;
+			for(size_t k = 0; indexed && k < keys.size(); k++) {
+				indexed = keys[k].offset >= sizeof(header) && keys[k].offset < trailer.index_offset
+						&& (k == 0 || (keys[k].generation > keys[k - 1].generation && keys[k].offset > keys[k - 1].offset));
+			}
+		}
+
+		if(indexed) {
+			//Only the frames after the last keyframe are scanned to find the end of the run
+			scan((keys.size() > 0)? keys.back().offset : sizeof(header), trailer.index_offset);
+		}
+		else {
+			keys.clear();
+			scan(sizeof(header), file_size);
+		}
+
+		num_words = recordingRowWords(header.width) * header.height;
+		words = huge_page_allocator::allocate<uint64_t>(num_words);
+		if(words == nullptr || keys.empty()) {
+			close();
+			return false;
+		}
+		next_offset = keys[0].offset;
+		decoded = false;
+		return true;
+	}
+
+	void close() {
+		if(file != nullptr) fclose(file);
+		file = nullptr;
+		huge_page_allocator::release(words, num_words);
+		words = nullptr;
+		num_words = 0;
+		keys.clear();
+		decoded = false;
+		data_end = next_offset = last_generation = 0;
+	}
+
+	inline bool is_open() const { return file != nullptr; }
+	inline uint64_t first_generation() const { return (keys.size() > 0)? keys[0].generation : 0; }
+	inline uint64_t row_words() const { return recordingRowWords(header.width); }
+	inline const uint64_t* row(uint64_t y) const { return words + y * row_words(); }
+	inline bool get(uint64_t x, uint64_t y) const { return (row(y)[x >> 6] >> (x & 63)) & 1; }
+
+	//Decodes the frame after the current one. Returns false at the end of the recording or on a malformed frame.
+	bool next() {
+		recording_frame f;
+		if(next_offset > data_end || data_end - next_offset < sizeof(f) || !read_at(next_offset, &f, sizeof(f))) return false;
+		if(f.type == RECORDING_DELTA && !decoded) return false;
+
+		//Frame sizes are bounded before anything is allocated for them, and no frame may be later than the end of the run
+		if(f.compressed_bytes > data_end - next_offset - sizeof(f) || f.raw_bytes > recordingMaxEncoded(num_words) || f.generation > last_generation) {
+			decoded = false;
+			return false;
+		}
+
+		compressed.resize(f.compressed_bytes);
+		encoded.resize(f.raw_bytes);
+		if(fread(compressed.data(), 1, compressed.size(), file) != compressed.size()
+			|| !recordingUncompress(compressed.data(), compressed.size(), encoded.data(), encoded.size())
+			|| !recordingDecode(encoded.data(), encoded.size(), words, num_words, f.type == RECORDING_DELTA)) {
+			decoded = false;
+			return false;
+		}
+
+		frame = f;
+		decoded = true;
+		next_offset += sizeof(f) + f.compressed_bytes;
+		return true;
+	}
+
+	//Decodes the last recorded frame at or before generation (the first frame if it's earlier than the recording).
+	//Continues from the current frame when no keyframe lies between it and the target.
+	bool seek(uint64_t generation) {
+		if(keys.empty()) return false;
+
+		//Keys are in generation order: find the first one past the target and step back
+		size_t k = std::upper_bound(keys.begin(), keys.end(), generation,
+			[](uint64_t g, const recording_key& key) { return g < key.generation; }) - keys.begin();
+		if(k > 0) k--;
+
+		if(!decoded || frame.generation > generation || frame.generation < keys[k].generation) {
+			next_offset = keys[k].offset;
+			decoded = false;
+			if(!next()) return false;
+		}
+
+		recording_frame f;
+		while(next_offset + sizeof(f) <= data_end && read_at(next_offset, &f, sizeof(f)) && f.generation <= generation) {
+			if(!next()) return false;
+		}
+		return true;
+	}
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
@@ -0,0 +1,80 @@
+//==============================================================================//
+//-------------------------Game of Life Buffer Self-Check-----------------------//
+//                                                                              //
+// Developed by: Travis Stewart                                                 //
+//                                                                              //
+//------------------------------------------------------------------------------//
+//==============================================================================//
+
+//Round-trips Buffer data between the GL and CV layouts, in place (format) and into another buffer (convert), across
+//sizes that leave partial blocks and uneven thread splits. Built by "make check" with AddressSanitizer and
+//BUFFER_BOUNDS_CHECK, so an out of range access fails loudly even when the values happen to come out right.
+#include "Buffer.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <random>
+
+//w x h x d: odd and prime sizes, single rows and columns, and planes larger than a conversion block
+const int check_sizes[][3] = {
+	{ 1, 1, 1 }, { 1, 1, 4 }, { 3, 5, 3 }, { 7, 11, 2 }, { 13, 1, 5 }, { 1, 17, 3 }, { 31, 37, 4 }, { 64, 63, 3 },
+	{ 127, 129, 2 }, { 257, 3, 7 }, { 65537, 1, 3 }, { 1, 70001, 4 }, { 104729, 1, 2 }, { 1031, 1033, 3 }
+};
+const unsigned check_threads[] = { 0, 1, 2, 3, 7 };
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Returns the number of mismatches for one size, type and thread count
+template <typename T>
+int checkRoundTrip(int w, int h, int d, unsigned threads, std::mt19937& rng) {
+	int bad = 0;
+	Buffer<T> a(w, h, d, BUFFER_FORMAT::GL);
+	for(int z = 0; z < d; z++) for(int y = 0; y < h; y++) for(int x = 0; x < w; x++) a(x, y, z) = (T)rng();
+	Buffer<T> ref = a.clone();
+
+	//GL -> CV in place: same elements, planes now contiguous
+	a.format(BUFFER_FORMAT::CV, threads);
+	if(a.format() != BUFFER_FORMAT::CV) bad++;
+	for(int z = 0; z < d; z++) for(int y = 0; y < h; y++) for(int x = 0; x < w; x++) bad += a(x, y, z) != ref(x, y, z);
+	size_t plane = (size_t)w * h;
+	for(size_t i = 0; i < a.size(); i++) bad += a(i) != ref((i % plane) * d + i / plane);
+
+	//CV -> GL into a new buffer, and GL -> CV into one that has the wrong size
+	Buffer<T, huge_page_allocator> gl;
+	a.convert(BUFFER_FORMAT::GL, gl, threads);
+	if(gl.format() != BUFFER_FORMAT::GL) bad++;
+	for(size_t i = 0; i < a.size(); i++) bad += gl(i) != ref(i);
+
+	Buffer<T> cv(3, 3, 3, BUFFER_FORMAT::CV);
+	ref.convert(BUFFER_FORMAT::CV, cv, threads);
+	for(size_t i = 0; i < a.size(); i++) bad += cv(i) != a(i);
+
+	//CV -> GL in place restores the original
+	a.format(BUFFER_FORMAT::GL, threads);
+	if(a.format() != BUFFER_FORMAT::GL) bad++;
+	for(size_t i = 0; i < a.size(); i++) bad += a(i) != ref(i);
+	return bad;
+}
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+int main(void) {
+	std::mt19937 rng(1);
+	int failures = 0;
+
+	for(const int* s : check_sizes) {
+		for(unsigned threads : check_threads) {
+			int bad = checkRoundTrip<uint8_t>(s[0], s[1], s[2], threads, rng) + checkRoundTrip<short>(s[0], s[1], s[2], threads, rng)
+					+ checkRoundTrip<float>(s[0], s[1], s[2], threads, rng) + checkRoundTrip<double>(s[0], s[1], s[2], threads, rng);
+			if(bad > 0) {
+				printf("FAILED | %i x %i x %i, %u threads: %i mismatches\n", s[0], s[1], s[2], threads, bad);
+				failures++;
+			}
+		}
+	}
+
+	printf("Buffer self-check | %s\n", (failures == 0)? "passed" : "FAILED");
+	return (failures == 0)? 0 : 1;
+}
@@ -0,0 +1,416 @@
+/*
+Snapshot functions -- Bit-packed binary board snapshots that can be restored through mmap without a parse step
+Developed by: Travis Stewart
+*/
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <vector>
+
+#include "Allocator.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//File layout:
+//	[0, 4096)				snapshot_header, zero padded
+//	[4096, ...)				height rows of row_stride bytes. Row y holds cell x at bit (x % 64) of word (x / 64).
+//							row_stride is a multiple of 64 bytes so every row starts on a cache line, and the data
+//							starts on a page so the rows can be mapped straight from the file.
+//Rows are stored in board order (row 0 is the bottom row on screen). Unused bits at the end of a row are zero.
+
+#define SNAPSHOT_MAGIC "GOLSNAP1"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_DATA_OFFSET 4096
+#define SNAPSHOT_ROW_ALIGN 64
+
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t data_offset;
+	uint64_t width;
+	uint64_t height;
+	uint64_t row_stride;		//Bytes per row
+	int32_t rule_birth;			//Neighbour count bitmasks, see pattern_rule
+	int32_t rule_survive;
+	uint64_t generation;
+	uint64_t population;
+	uint64_t hash;				//snapshotHash() over all rows, including the padding words
+};
+
+inline uint64_t snapshotRowStride(uint64_t width) { return ((width + 511) / 512) * SNAPSHOT_ROW_ALIGN; }
+
+//Word-at-a-time hash of the packed rows
+inline uint64_t snapshotHash(uint64_t h, const uint64_t* words, size_t n) {
+	for(size_t i = 0; i < n; i++) {
+		h ^= words[i];
+		h *= 0x9E3779B97F4A7C15ull;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+#define SNAPSHOT_HASH_SEED 0xCBF29CE484222325ull
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Packs n cells into words, reading every stride-th element (stride is the Buffer depth for GL formatted planes)
+inline void packRow(const bool* cells, ptrdiff_t stride, size_t n, uint64_t* words, size_t num_words) {
+	size_t x = 0;
+	for(size_t w = 0; w < num_words; w++) {
+		uint64_t bits = 0;
+		size_t end = (x + 64 < n)? x + 64 : n;
+		for(size_t b = 0; x < end; x++, b++) bits |= (uint64_t)cells[x * stride] << b;
+		words[w] = bits;
+	}
+}
+
+inline void unpackRow(const uint64_t* words, size_t n, bool* cells, ptrdiff_t stride) {
+	for(size_t x = 0; x < n; x++) cells[x * stride] = (words[x >> 6] >> (x & 63)) & 1;
+}
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+//File handles for the writer and view: POSIX descriptors, or Win32 handles
+#if defined(_WIN32)
+typedef HANDLE snapshot_file;
+#define SNAPSHOT_NO_FILE INVALID_HANDLE_VALUE
+#else
+typedef int snapshot_file;
+#define SNAPSHOT_NO_FILE -1
+#endif
+
+//Creates (or truncates) file_name for writing. direct is set when writes must be whole pages (O_DIRECT).
+//Windows always writes through the cache: unbuffered handles can't be switched back for the last partial page.
+inline snapshot_file snapshotCreate(const char* file_name, bool direct_io, bool& direct) {
+	direct = false;
+#if defined(_WIN32)
+	(void)direct_io;
+	return CreateFileA(file_name, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+#else
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+	int fd = -1;
+	#ifdef __linux__
+	if(direct_io) {
+		fd = ::open(file_name, flags | O_DIRECT, 0644);
+		direct = fd >= 0;
+	}
+	#endif
+	if(fd < 0) fd = ::open(file_name, flags, 0644);
+	#ifdef __APPLE__
+	if(fd >= 0 && direct_io) fcntl(fd, F_NOCACHE, 1);
+	#endif
+	return fd;
+#endif
+}
+
+inline snapshot_file snapshotOpen(const char* file_name) {
+#if defined(_WIN32)
+	return CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+	return ::open(file_name, O_RDONLY);
+#endif
+}
+
+inline void snapshotClose(snapshot_file f) {
+#if defined(_WIN32)
+	CloseHandle(f);
+#else
+	::close(f);
+#endif
+}
+
+//Turns direct I/O off so the final partial page can be written
+inline void snapshotBuffered(snapshot_file f) {
+#if defined(__linux__) && !defined(_WIN32)
+	fcntl(f, F_SETFL, fcntl(f, F_GETFL) & ~O_DIRECT);
+#else
+	(void)f;
+#endif
+}
+
+//Writes all bytes at the current position
+inline bool snapshotWrite(snapshot_file f, const char* p, size_t bytes) {
+	while(bytes > 0) {
+#if defined(_WIN32)
+		DWORD n = 0;
+		if(!WriteFile(f, p, (DWORD)((bytes < (1u << 30))? bytes : (1u << 30)), &n, nullptr) || n == 0) return false;
+#else
+		ssize_t n = ::write(f, p, bytes);
+		if(n <= 0) return false;
+#endif
+		p += n;
+		bytes -= n;
+	}
+	return true;
+}
+
+//Single transfers at an absolute offset, for the header page
+inline bool snapshotWriteAt(snapshot_file f, const void* p, uint32_t bytes, uint64_t offset) {
+#if defined(_WIN32)
+	OVERLAPPED at = {};
+	at.Offset = (DWORD)offset;
+	at.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD n = 0;
+	return WriteFile(f, p, bytes, &n, &at) && n == bytes;
+#else
+	return pwrite(f, p, bytes, (off_t)offset) == (ssize_t)bytes;
+#endif
+}
+
+inline bool snapshotReadAt(snapshot_file f, void* p, uint32_t bytes, uint64_t offset) {
+#if defined(_WIN32)
+	OVERLAPPED at = {};
+	at.Offset = (DWORD)offset;
+	at.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD n = 0;
+	return ReadFile(f, p, bytes, &n, &at) && n == bytes;
+#else
+	return pread(f, p, bytes, (off_t)offset) == (ssize_t)bytes;
+#endif
+}
+
+inline bool snapshotSeek(snapshot_file f, uint64_t offset) {
+#if defined(_WIN32)
+	LARGE_INTEGER to;
+	to.QuadPart = (LONGLONG)offset;
+	return SetFilePointerEx(f, to, nullptr, FILE_BEGIN) != 0;
+#else
+	return lseek(f, (off_t)offset, SEEK_SET) == (off_t)offset;
+#endif
+}
+
+inline bool snapshotSize(snapshot_file f, uint64_t& bytes) {
+#if defined(_WIN32)
+	LARGE_INTEGER size;
+	if(!GetFileSizeEx(f, &size)) return false;
+	bytes = (uint64_t)size.QuadPart;
+#else
+	struct stat st;
+	if(fstat(f, &st) != 0) return false;
+	bytes = (uint64_t)st.st_size;
+#endif
+	return true;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Streams rows to disk through a large page aligned buffer. The header (with the hash and population) is written on
+//close(). With direct I/O (O_DIRECT on Linux, F_NOCACHE on macOS) the data bypasses the page cache, so multi-GB
+//checkpoints don't evict the board from memory; it silently falls back to buffered I/O where unsupported (Windows).
+class snapshot_writer {
+private:
+	snapshot_file fd;
+	snapshot_header header;
+	char* chunk;
+	size_t chunk_bytes;		//Multiple of SNAPSHOT_DATA_OFFSET (the page size used for direct I/O)
+	size_t used;			//Bytes in chunk
+	uint64_t rows_written;
+	uint64_t hash;
+	bool direct;
+	bool failed;
+
+	//Direct I/O can only write whole pages, so the tail is kept for the next flush
+	void flush(bool final) {
+		if(failed) { used = 0; return; }
+
+		size_t bytes = (direct && !final)? used - (used % SNAPSHOT_DATA_OFFSET) : used;
+		if(final && direct) {
+			snapshotBuffered(fd);
+			direct = false;
+		}
+
+		if(!snapshotWrite(fd, chunk, bytes)) failed = true;
+		memmove(chunk, chunk + bytes, used - bytes);
+		used -= bytes;
+	}
+
+	void reserve(size_t bytes) {
+		bytes = ((bytes + SNAPSHOT_DATA_OFFSET - 1) / SNAPSHOT_DATA_OFFSET) * SNAPSHOT_DATA_OFFSET;
+		if(chunk != nullptr && bytes <= chunk_bytes) return;
+
+		void* p = page_aligned_allocator::allocate_bytes(bytes);
+		if(p == nullptr) { failed = true; return; }
+		if(chunk != nullptr) { memcpy(p, chunk, used); page_aligned_allocator::release_bytes(chunk); }
+		chunk = (char*)p;
+		chunk_bytes = bytes;
+	}
+
+public:
+	snapshot_writer(size_t bytes = 8 << 20): fd(SNAPSHOT_NO_FILE), chunk(nullptr), chunk_bytes(0), used(0), rows_written(0), hash(SNAPSHOT_HASH_SEED), direct(false), failed(false) { reserve(bytes); }
+	~snapshot_writer() { close(); page_aligned_allocator::release_bytes(chunk); }
+
+	inline uint64_t row_words() const { return header.row_stride / sizeof(uint64_t); }
+
+	bool open(const char* file_name, uint64_t width, uint64_t height, int birth, int survive, uint64_t generation, bool direct_io = false) {
+		close();
+		fd = snapshotCreate(file_name, direct_io, direct);
+		if(fd == SNAPSHOT_NO_FILE) return false;
+
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, SNAPSHOT_MAGIC, 8);
+		header.version = SNAPSHOT_VERSION;
+		header.data_offset = SNAPSHOT_DATA_OFFSET;
+		header.width = width;
+		header.height = height;
+		header.row_stride = snapshotRowStride(width);
+		header.rule_birth = birth;
+		header.rule_survive = survive;
+		header.generation = generation;
+
+		used = 0;
+		rows_written = 0;
+		hash = SNAPSHOT_HASH_SEED;
+		failed = false;
+
+		//A row plus a partial page must always fit
+		reserve(header.row_stride + SNAPSHOT_DATA_OFFSET);
+
+		//Leave room for the header, it's filled in by close()
+		if(!snapshotSeek(fd, SNAPSHOT_DATA_OFFSET)) failed = true;
+		if(failed) {
+			snapshotClose(fd);
+			fd = SNAPSHOT_NO_FILE;
+		}
+		return !failed;
+	}
+
+	//Appends the next row. words must hold row_words() words with the unused bits cleared.
+	void write_row(const uint64_t* words) {
+		size_t n = row_words();
+		if(used + header.row_stride > chunk_bytes) flush(false);
+		memcpy(chunk + used, words, header.row_stride);
+		used += header.row_stride;
+
+		hash = snapshotHash(hash, words, n);
+		for(size_t w = 0; w < n; w++) header.population += __builtin_popcountll(words[w]);
+		rows_written++;
+	}
+
+	//Returns false if any write failed or not every row was written
+	bool close() {
+		if(fd == SNAPSHOT_NO_FILE) return false;
+		flush(true);
+
+		//The header page is aligned, so this works whether or not direct I/O is still on
+		header.hash = hash;
+		memset(chunk, 0, SNAPSHOT_DATA_OFFSET);
+		memcpy(chunk, &header, sizeof(header));
+		if(!snapshotWriteAt(fd, chunk, SNAPSHOT_DATA_OFFSET, 0)) failed = true;
+		if(rows_written != header.height) failed = true;
+
+		snapshotClose(fd);
+		fd = SNAPSHOT_NO_FILE;
+		return !failed;
+	}
+};
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Read-only mapping of a snapshot file. Pages are only read from disk when a row is touched.
+class snapshot_view {
+private:
+	snapshot_file fd;
+#if defined(_WIN32)
+	HANDLE mapping;
+#endif
+	const char* map;		//nullptr when not mapped
+	size_t map_size;
+
+public:
+	snapshot_header header;
+
+#if defined(_WIN32)
+	snapshot_view(): fd(SNAPSHOT_NO_FILE), mapping(nullptr), map(nullptr), map_size(0) { memset(&header, 0, sizeof(header)); }
+#else
+	snapshot_view(): fd(SNAPSHOT_NO_FILE), map(nullptr), map_size(0) { memset(&header, 0, sizeof(header)); }
+#endif
+	~snapshot_view() { close(); }
+
+	bool open(const char* file_name) {
+		close();
+		fd = snapshotOpen(file_name);
+		if(fd == SNAPSHOT_NO_FILE) return false;
+
+		//The sizes come from the file, so a crafted header mustn't be able to wrap the mapping size. The data must
+		//start where the writer puts it, which keeps every row 64 byte aligned for the word reads in row().
+		uint64_t file_size = 0;
+		if(!snapshotSize(fd, file_size) || file_size < SNAPSHOT_DATA_OFFSET || !snapshotReadAt(fd, &header, sizeof(header), 0)
+			|| memcmp(header.magic, SNAPSHOT_MAGIC, 8) != 0 || header.version != SNAPSHOT_VERSION || header.data_offset != SNAPSHOT_DATA_OFFSET
+			|| header.width > UINT64_MAX - 511
+			|| header.row_stride != snapshotRowStride(header.width) || (header.height != 0 && header.row_stride > UINT64_MAX / header.height)
+			|| header.row_stride * header.height > UINT64_MAX - header.data_offset || header.data_offset + header.row_stride * header.height > SIZE_MAX
+			|| file_size < header.data_offset + header.row_stride * header.height) {
+			close();
+			return false;
+		}
+
+		map_size = header.data_offset + header.row_stride * header.height;
+#if defined(_WIN32)
+		mapping = CreateFileMappingA(fd, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(mapping != nullptr) map = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, map_size);
+		if(map == nullptr) { close(); return false; }
+#else
+		void* p = mmap(nullptr, map_size, PROT_READ, MAP_SHARED, fd, 0);
+		if(p == MAP_FAILED) { close(); return false; }
+		map = (const char*)p;
+
+		//Rows are mostly read front to back when restoring
+		madvise(p, map_size, MADV_SEQUENTIAL);
+#endif
+		return true;
+	}
+
+	void close() {
+#if defined(_WIN32)
+		if(map != nullptr) UnmapViewOfFile(map);
+		if(mapping != nullptr) CloseHandle(mapping);
+		mapping = nullptr;
+#else
+		if(map != nullptr) munmap((void*)map, map_size);
+#endif
+		if(fd != SNAPSHOT_NO_FILE) snapshotClose(fd);
+		map = nullptr;
+		map_size = 0;
+		fd = SNAPSHOT_NO_FILE;
+	}
+
+	inline bool is_open() const { return map != nullptr; }
+	inline uint64_t row_words() const { return header.row_stride / sizeof(uint64_t); }
+
+	inline const uint64_t* row(uint64_t y) const { return (const uint64_t*)(map + header.data_offset + y * header.row_stride); }
+	inline bool get(uint64_t x, uint64_t y) const { return (row(y)[x >> 6] >> (x & 63)) & 1; }
+
+	//Recomputes the row hash, touching every page. restoreSnapshot calls it before unpacking, so a damaged file is
+	//refused with the board untouched at the cost of one extra pass over the mapping.
+	bool verify() const {
+		uint64_t h = SNAPSHOT_HASH_SEED;
+		for(uint64_t y = 0; y < header.height; y++) h = snapshotHash(h, row(y), row_words());
+		return h == header.hash;
+	}
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
@@ -0,0 +1,196 @@
+/*
+Trace class -- Opt-in timeline recorder that writes Chrome trace (chrome://tracing, Perfetto) JSON files
+Developed by: Travis Stewart
+*/
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#define TRACE_RING_SIZE 65536		//Events kept per thread (power of two). Older events are overwritten.
+
+struct trace_event {
+	const char* name;		//Must be a string literal, only the pointer is stored
+	uint64_t ts_ns;
+	uint64_t dur_ns;
+	long long arg;			//Optional value shown in the event details (e.g. the generation), -1 for none
+};
+
+class trace_recorder {
+private:
+	//Each thread appends to its own ring, so recording never takes a lock. When the thread exits its ring goes back
+	//to the pool, and a later thread with the same name carries on in it (same timeline row), so restarting the
+	//simulation threads doesn't grow the trace. A ring never changes name once it holds events.
+	struct trace_ring {
+		int tid;
+		std::string thread_name;
+		std::atomic<uint64_t> head;
+		std::vector<trace_event> events;
+		bool named = false;
+		bool in_use = true;
+
+		trace_ring(int t): tid(t), thread_name("thread " + std::to_string(t)), head(0), events(TRACE_RING_SIZE) {}
+	};
+
+	//The calling thread's ring, released when the thread exits
+	struct trace_lease {
+		trace_recorder* owner = nullptr;
+		trace_ring* ring = nullptr;
+
+		~trace_lease() { if(owner != nullptr) owner->release(ring); }
+	};
+
+	std::mutex rings_mtx;
+	std::vector<trace_ring*> rings;
+	std::atomic<bool> trace_enabled;
+	uint64_t start_ns;
+
+	trace_lease& lease() {
+		thread_local trace_lease l;
+		if(l.owner != this) {
+			if(l.owner != nullptr) l.owner->release(l.ring);
+			std::lock_guard<std::mutex> lock(rings_mtx);
+			l.ring = acquire(nullptr);
+			l.owner = this;
+		}
+		return l;
+	}
+
+	inline trace_ring* local() { return lease().ring; }
+
+	//A free ring last used under the same name (nullptr for unnamed threads), or a new one. rings_mtx must be held.
+	trace_ring* acquire(const std::string* name) {
+		for(size_t i = 0; i < rings.size(); i++) {
+			trace_ring* ring = rings[i];
+			if(ring->in_use || ring->named != (name != nullptr) || (name != nullptr && ring->thread_name != *name)) continue;
+			ring->in_use = true;
+			return ring;
+		}
+		trace_ring* ring = new trace_ring((int)rings.size());
+		if(name != nullptr) {
+			ring->thread_name = *name;
+			ring->named = true;
+		}
+		rings.push_back(ring);
+		return ring;
+	}
+
+	void release(trace_ring* ring) {
+		std::lock_guard<std::mutex> lock(rings_mtx);
+		ring->in_use = false;
+	}
+
+public:
+	trace_recorder(): trace_enabled(false), start_ns(now()) {}
+
+	~trace_recorder() {
+		for(size_t i = 0; i < rings.size(); i++) delete rings[i];
+	}
+
+	static inline uint64_t now() {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	inline bool enabled() const { return trace_enabled.load(std::memory_order_relaxed); }
+	inline void enable(bool e) { if(e && !enabled()) start_ns = now(); trace_enabled = e; }
+
+	//Label the calling thread in the timeline. Moves the thread to the row last used under this name, so events
+	//already recorded under another name keep their label.
+	void name_thread(const std::string& name) {
+		if(!enabled()) return;
+		trace_lease& l = lease();
+		std::lock_guard<std::mutex> lock(rings_mtx);
+		trace_ring* ring = l.ring;
+		if(ring->named && ring->thread_name == name) return;
+
+		//An empty ring can simply be relabelled, unless a row with this name is free to continue in
+		bool relabel = ring->head.load(std::memory_order_relaxed) == 0;
+		for(size_t i = 0; relabel && i < rings.size(); i++) relabel = rings[i]->in_use || !rings[i]->named || rings[i]->thread_name != name;
+		if(relabel) {
+			ring->thread_name = name;
+			ring->named = true;
+			return;
+		}
+
+		ring->in_use = false;
+		l.ring = acquire(&name);
+	}
+
+	//Record a complete event for the calling thread
+	inline void complete(const char* name, uint64_t begin_ns, uint64_t end_ns, long long arg = -1) {
+		if(!enabled()) return;
+		trace_ring* ring = local();
+		uint64_t h = ring->head.load(std::memory_order_relaxed);
+		trace_event& e = ring->events[h & (TRACE_RING_SIZE - 1)];
+		e.name = name;
+		e.ts_ns = begin_ns;
+		e.dur_ns = end_ns - begin_ns;
+		e.arg = arg;
+		ring->head.store(h + 1, std::memory_order_release);
+	}
+
+	//-------------------------------------------------------------------------------------------------------------------------
+
+	//Write all recorded events. Threads should be stopped first, otherwise the newest events may be torn.
+	bool write(const char* file_name) {
+		FILE* file = fopen(file_name, "w");
+		if(file == nullptr) return false;
+
+		std::lock_guard<std::mutex> lock(rings_mtx);
+		bool failed = fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n") < 0;
+
+		bool first = true;
+		for(size_t r = 0; r < rings.size(); r++) {
+			trace_ring* ring = rings[r];
+			if(fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"%s\"}}", (first)? "" : ",\n", ring->tid, ring->thread_name.c_str()) < 0) failed = true;
+			first = false;
+
+			uint64_t h = ring->head.load(std::memory_order_acquire);
+			uint64_t begin = (h > TRACE_RING_SIZE)? h - TRACE_RING_SIZE : 0;
+			for(uint64_t i = begin; i < h; i++) {
+				const trace_event& e = ring->events[i & (TRACE_RING_SIZE - 1)];
+				double ts = (e.ts_ns >= start_ns)? (e.ts_ns - start_ns) / 1000.0 : 0.0;
+				if(fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%i,\"ts\":%.3f,\"dur\":%.3f", e.name, ring->tid, ts, e.dur_ns / 1000.0) < 0) failed = true;
+				if(e.arg >= 0 && fprintf(file, ",\"args\":{\"value\":%lld}", e.arg) < 0) failed = true;
+				if(fprintf(file, "}") < 0) failed = true;
+			}
+		}
+
+		if(fprintf(file, "\n]}\n") < 0) failed = true;
+		if(fflush(file) != 0 || ferror(file)) failed = true;
+		if(fclose(file) != 0) failed = true;
+		return !failed;
+	}
+};
+
+//-------------------------------------------------------------------------------------------------------------------------
+
+//Records the lifetime of the scope as one event. Costs a single relaxed load when tracing is off.
+struct trace_scope {
+	trace_recorder& recorder;
+	const char* name;
+	long long arg;
+	uint64_t t_begin;
+
+	trace_scope(trace_recorder& r, const char* n, long long a = -1): recorder(r), name(n), arg(a), t_begin(r.enabled()? trace_recorder::now() : 0) {}
+	~trace_scope() { if(t_begin != 0) recorder.complete(name, t_begin, trace_recorder::now(), arg); }
+};
+
+//=========================================================================================================================
+//-------------------------------------------------------------------------------------------------------------------------
+//=========================================================================================================================
+
+#endif
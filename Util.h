@@ -19,12 +19,18 @@ Developed by: Travis Stewart
 #include <string>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <chrono>
 #include <map>
 #include <unordered_map>
 #include <queue>
+#include <functional>
 
 //OpenGL Includes
+#ifndef _WIN32
+#define GL_GLEXT_PROTOTYPES		//Buffer object entry points for the pixel buffer uploads (loaded at run time on Windows)
+#endif
 #ifdef __APPLE__
 #include "GLUT/glut.h"
 #include <OpenGL/gl.h>
@@ -32,6 +38,7 @@ Developed by: Travis Stewart
 #include <windows.h>
 #include "GL/glut.h"
 #include <gl/gl.h>
+#include <GL/glext.h>			//Enums and entry point types past GL 1.1
 #endif
 
 
@@ -264,6 +271,115 @@ struct timer {
 
 };
 
+//Reusable thread barrier. The last thread to arrive runs the completion function before the others are released.
+struct thread_barrier {
+	std::mutex mtx;
+	std::condition_variable cv;
+	int threshold = 1;
+	int count = 1;
+	unsigned long long phase = 0;
+
+	//Set the number of participating threads. Only call while no thread is waiting.
+	inline void reset(int n) {
+		std::lock_guard<std::mutex> lock(mtx);
+		threshold = count = (n <= 0)? 1 : n;
+	}
+
+	template <class F>
+	inline void wait(F completion) {
+		std::unique_lock<std::mutex> lock(mtx);
+		unsigned long long p = phase;
+		if(--count == 0) {
+			completion();
+			phase++;
+			count = threshold;
+			cv.notify_all();
+			return;
+		}
+		cv.wait(lock, [&]{ return phase != p; });
+	}
+
+	inline void wait() { wait([]{}); }
+};
+
+//Fixed set of threads that split a loop between them. The calling thread takes items too, and run() returns once
+//every item is done and every worker has left the loop, so fn can safely capture locals.
+struct worker_pool {
+	std::vector<std::thread> threads;
+	std::mutex mtx;
+	std::condition_variable cv, done_cv;
+	std::function<void(int)> job;
+	std::atomic<int> next{0};
+	int items = 0;
+	int finished = 0;				//Workers done with the current phase
+	unsigned long long phase = 0;
+	bool running = false;
+
+	~worker_pool() { stop(); }
+
+	inline int size() const { return (int)threads.size(); }
+
+	//Starts n worker threads (n can be 0, then run() is a plain loop)
+	void start(int n) {
+		stop();
+		running = true;
+		for(int i = 0; i < n; i++) threads.push_back(std::thread(&worker_pool::work, this));
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			running = false;
+		}
+		cv.notify_all();
+		for(size_t i = 0; i < threads.size(); i++) if(threads[i].joinable()) threads[i].join();
+		threads.clear();
+	}
+
+	//Calls fn(i) for every i in [0, n), in no particular order
+	void run(int n, const std::function<void(int)>& fn) {
+		if(threads.empty() || n <= 1) {
+			for(int i = 0; i < n; i++) fn(i);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			job = fn;
+			items = n;
+			next = 0;
+			finished = 0;
+			phase++;
+		}
+		cv.notify_all();
+		drain();
+
+		std::unique_lock<std::mutex> lock(mtx);
+		done_cv.wait(lock, [&]{ return finished == (int)threads.size(); });
+		job = nullptr;
+	}
+
+private:
+	inline void drain() {
+		for(int i = next++; i < items; i = next++) job(i);
+	}
+
+	void work() {
+		unsigned long long seen = 0;
+		std::unique_lock<std::mutex> lock(mtx);
+		while(true) {
+			cv.wait(lock, [&]{ return phase != seen || !running; });
+			if(!running) return;
+			seen = phase;
+
+			lock.unlock();
+			drain();
+			lock.lock();
+			if(++finished == (int)threads.size()) done_cv.notify_all();
+		}
+	}
+};
+
 
 
 